@@ -0,0 +1,74 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#ifndef _BENCH_UTIL_H
+#define	_BENCH_UTIL_H
+
+/*
+ * Timing shared by the benchmarks: wall clock time in ms, a stopwatch
+ * summing the runs of one step, and the count (iterations, events) given
+ * on the command line.
+ */
+
+#include <sys/time.h>
+#include <stdlib.h>
+
+static inline double
+now_ms()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+class Stopwatch {
+public:
+    Stopwatch() : total(0), started(0) {}
+
+    void start() { started = now_ms(); }
+    /* adds the time since start() and returns it */
+    double stop()
+    {
+        double lap = now_ms() - started;
+        total += lap;
+        return lap;
+    }
+    /* of all runs */
+    double ms() const { return total; }
+
+private:
+    double total;
+    double started;
+};
+
+/* argument index of argv, fallback when missing or not positive */
+static inline long
+bench_count(int argc, char** argv, int index, long fallback)
+{
+    long count = argc > index ? atol(argv[index]) : fallback;
+    return count > 0 ? count : fallback;
+}
+
+#endif	/* _BENCH_UTIL_H */
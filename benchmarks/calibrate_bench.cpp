@@ -0,0 +1,146 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+/*
+ * Measures edge calibration per event: EdgeCalibrator, and its block
+ * kernel alone, against keeping every sample and selecting the percentiles
+ * from them afterwards. The edges of both are compared; they may differ by the
+ * width of a histogram bin.
+ *
+ * Usage: calibrate_bench [events]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "touchpad_calibrate.h"
+#include "bench_util.h"
+
+/*
+ * A finger sweeping a 1472-5472 x 1408-4448 touchpad, with a stray
+ * reading every 3000 events and a lifted finger every 500
+ */
+static TraceEvent
+sweep(long i)
+{
+    TraceEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.time = 1000 + i * 12;
+    ev.type = TRACE_MOTION;
+    ev.values[TRACE_X] = 3472 + (int)(2000 * sin(i / 37.0));
+    ev.values[TRACE_Y] = 2928 + (int)(1520 * sin(i / 53.0));
+    ev.values[TRACE_PRESSURE] = i % 500 ? 40 : 0;
+    ev.values[TRACE_WIDTH] = 4;
+    if (i % 3000 == 1500)
+        ev.values[TRACE_X] = 8000;
+    return ev;
+}
+
+static int
+select_percentile(std::vector<int>& samples, double fraction)
+{
+    size_t rank = (size_t)(fraction * samples.size() + 0.999999);
+    rank = rank ? rank - 1 : 0;
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+int
+main(int argc, char** argv)
+{
+    long events = bench_count(argc, argv, 1, 1000000);
+
+    std::vector<TraceEvent> input(events);
+    for (long i = 0; i < events; i++)
+        input[i] = sweep(i);
+
+    EdgeCalibrator calibrator;
+    param_values proposal;
+    Stopwatch streaming, stored, kernel;
+    streaming.start();
+    for (long i = 0; i < events; i++)
+        calibrator.add(input[i]);
+    bool proposed = calibrator.propose(proposal);
+    streaming.stop();
+
+    /* the same filtering, every sample kept */
+    std::vector<int> xs, ys;
+    stored.start();
+    for (long i = 0; i < events; i++) {
+        const TraceEvent& ev = input[i];
+        if (ev.values[TRACE_PRESSURE] <= 0)
+            continue;
+        xs.push_back(ev.values[TRACE_X]);
+        ys.push_back(ev.values[TRACE_Y]);
+    }
+    std::vector<int> kept_x(xs), kept_y(ys);
+    int edges[4];
+    edges[0] = select_percentile(xs, CALIBRATE_CUTOFF);
+    edges[1] = select_percentile(xs, 1 - CALIBRATE_CUTOFF);
+    edges[2] = select_percentile(ys, CALIBRATE_CUTOFF);
+    edges[3] = select_percentile(ys, 1 - CALIBRATE_CUTOFF);
+    stored.stop();
+
+    /* the kernel alone, on the samples add() lets through */
+    EdgeCalibrator blocks;
+    kernel.start();
+    for (size_t i = 0; i < kept_x.size(); i += CALIBRATE_BLOCK) {
+        size_t n = std::min((size_t)CALIBRATE_BLOCK, kept_x.size() - i);
+        blocks.add_block(&kept_x[i], &kept_y[i], n);
+    }
+    kernel.stop();
+
+    static const char* const area[] = {
+        "AreaLeftEdge", "AreaRightEdge", "AreaTopEdge", "AreaBottomEdge"
+    };
+    int worst = 0;
+    for (int k = 0; k < 4; k++) {
+        int difference = abs((int)proposal[area[k]] - edges[k]);
+        if (difference > worst)
+            worst = difference;
+    }
+
+    printf("%-10s %10.2f ns/event\n", "streaming", streaming.ms() * 1e6 / events);
+    printf("%-10s %10.2f ns/sample\n", "kernel", kernel.ms() * 1e6 / kept_x.size());
+    printf("%-10s %10.2f ns/event, %lu bytes kept\n", "stored", stored.ms() * 1e6 / events,
+           (unsigned long)(xs.size() + ys.size()) * sizeof(int));
+    printf("%lu samples; edges %d %d %d %d, area %d %d %d %d; off by %d at most\n",
+           calibrator.samples(),
+           (int)proposal["LeftEdge"], (int)proposal["RightEdge"],
+           (int)proposal["TopEdge"], (int)proposal["BottomEdge"],
+           (int)proposal["AreaLeftEdge"], (int)proposal["AreaRightEdge"],
+           (int)proposal["AreaTopEdge"], (int)proposal["AreaBottomEdge"], worst);
+
+    if (blocks.minimum(TRACE_X) != calibrator.minimum(TRACE_X) ||
+        blocks.maximum(TRACE_Y) != calibrator.maximum(TRACE_Y))
+        worst = -1;
+
+    return proposed && worst >= 0 && worst <= (1 << CALIBRATE_SHIFT) ? 0 : 1;
+}
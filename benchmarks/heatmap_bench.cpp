@@ -0,0 +1,108 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+/*
+ * Measures the touch density heatmap: the cost of counting an event, and
+ * what a view gets per frame at 25 frames a second from a touchpad
+ * reporting 80 times a second, in cells to repaint. The counts taken
+ * frame by frame are compared with the total.
+ *
+ * Usage: heatmap_bench [events]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "touchpad_heatmap.h"
+#include "bench_util.h"
+
+/* A finger wandering over the touchpad, lifted every 300 events */
+static TraceEvent
+wander(long i)
+{
+    TraceEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.time = 1000 + i * 12;
+    ev.type = TRACE_MOTION;
+    ev.values[TRACE_X] = 3472 + (int)(1800 * sin(i / 97.0) * cos(i / 1301.0));
+    ev.values[TRACE_Y] = 2928 + (int)(1300 * sin(i / 61.0 + 1));
+    ev.values[TRACE_PRESSURE] = i % 300 < 20 ? 0 : 40;
+    ev.values[TRACE_WIDTH] = 4;
+    return ev;
+}
+
+int
+main(int argc, char** argv)
+{
+    long events = bench_count(argc, argv, 1, 1000000);
+
+    std::vector<TraceEvent> input(events);
+    for (long i = 0; i < events; i++)
+        input[i] = wander(i);
+
+    TouchHeatmap heatmap;
+    heatmap.set_edges(1632, 5312, 1575, 4281);
+    Stopwatch counting, taking;
+    counting.start();
+    for (long i = 0; i < events; i++)
+        heatmap.add(input[i]);
+    counting.stop();
+
+    /* again, taking the changes as a view would */
+    static unsigned long view[HEATMAP_CELLS];
+    unsigned cells[HEATMAP_CELLS];
+    heatmap.reset();
+    heatmap.take_changes(cells, HEATMAP_CELLS);
+    long frames = 0, changes = 0;
+    for (long i = 0; i < events; i++) {
+        heatmap.add(input[i]);
+        /* 80 reports a second, 25 frames */
+        if ((i + 1) * 25 / 80 != i * 25 / 80 || i == events - 1) {
+            taking.start();
+            unsigned n = heatmap.take_changes(cells, HEATMAP_CELLS);
+            for (unsigned k = 0; k < n; k++)
+                view[cells[k]] = heatmap.count(cells[k]);
+            taking.stop();
+            changes += n;
+            frames++;
+        }
+    }
+
+    unsigned long seen = 0;
+    for (unsigned cell = 0; cell < HEATMAP_CELLS; cell++)
+        seen += view[cell];
+
+    printf("%-10s %10.2f ns/event\n", "count", counting.ms() * 1e6 / events);
+    printf("%-10s %10.2f us/frame, %.1f of %d cells changed per frame\n", "frame",
+           taking.ms() * 1e3 / frames, (double)changes / frames, HEATMAP_CELLS);
+    printf("%lu of %ld events counted, %lu seen by the view, %lu bytes\n",
+           heatmap.touches(), events, seen, (unsigned long)sizeof(heatmap));
+
+    return seen == heatmap.touches() ? 0 : 1;
+}
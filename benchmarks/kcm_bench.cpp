@@ -0,0 +1,156 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+/*
+ * Times the control module against the fake touchpad: opening the dialog
+ * with a load()/save() cycle and the kcminit entry point, in wall time and
+ * round trips. Widgets need an X display (Xvfb will do), the touchpad is
+ * never touched. Settings go to a temporary KDEHOME.
+ *
+ * Usage: kcm_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <QApplication>
+#include <QEvent>
+
+#include <KComponentData>
+#include <KConfigGroup>
+#include <KSharedConfig>
+
+#include "kcmtouchpad.h"
+#include "touchpad_backend.h"
+#include "bench_util.h"
+
+/* Accumulated time and round trips of one step */
+struct Step {
+    const char* name;
+    Stopwatch time;
+    unsigned long round_trips;
+
+    Step(const char* label) : name(label), round_trips(0) {}
+};
+
+static void
+print_step(const Step& step, int iterations)
+{
+    printf("%-12s %12.3f ms %10.1f\n", step.name, step.time.ms() / iterations,
+           (double)step.round_trips / iterations);
+}
+
+/* Settings differing from the driver defaults, so applying them does work */
+static void
+write_settings()
+{
+    KSharedConfigPtr rc = KSharedConfig::openConfig("kcmtouchpadrc");
+    KConfigGroup touchpad(rc, "Touchpad");
+    touchpad.writeEntry("SmartModeEnabled", false);
+    touchpad.writeEntry("FingerLow", 5);
+    touchpad.writeEntry("VertEdgeScroll", 0);
+    touchpad.writeEntry("HorizEdgeScroll", 1);
+    touchpad.writeEntry("VertScrollDelta", 50);
+    touchpad.writeEntry("CoastingSpeed", 0.0);
+    touchpad.writeEntry("CircularScrolling", 1);
+    touchpad.writeEntry("MaxTapMove", 200);
+    touchpad.writeEntry("SingleTapTimeout", 150);
+    touchpad.writeEntry("TapButton1", 1);
+    touchpad.writeEntry("TapButton2", 2);
+    rc->sync();
+}
+
+int
+main(int argc, char** argv)
+{
+    int iterations = bench_count(argc, argv, 1, 20);
+
+    char home[] = "/tmp/kcm_bench.XXXXXX";
+    if (!mkdtemp(home)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    setenv("KDEHOME", home, 1);
+    setenv("KCM_TOUCHPAD_BACKEND", "fake", 1);
+
+    QApplication app(argc, argv);
+    KComponentData component("kcm_bench");
+    write_settings();
+
+    Step open("open");
+    Step load("load");
+    Step save("save");
+    Step init("init");
+    Step deferred("init+defer");
+
+    for (int i = 0; i < iterations; i++) {
+        fake_device_reset();
+
+        open.time.start();
+        TouchpadConfig* kcm = new TouchpadConfig(NULL, QVariantList());
+        open.time.stop();
+        open.round_trips += fake_device_counters().round_trips;
+
+        unsigned long trips = fake_device_counters().round_trips;
+        load.time.start();
+        kcm->load();
+        load.time.stop();
+        load.round_trips += fake_device_counters().round_trips - trips;
+
+        /* apply() and writing the settings */
+        trips = fake_device_counters().round_trips;
+        save.time.start();
+        kcm->save();
+        save.time.stop();
+        save.round_trips += fake_device_counters().round_trips - trips;
+
+        delete kcm;
+    }
+
+    for (int i = 0; i < iterations; i++) {
+        fake_device_reset();
+
+        init.time.start();
+        deferred.time.start();
+        TouchpadConfig::init_touchpad();
+        init.time.stop();
+        init.round_trips += fake_device_counters().round_trips;
+
+        /* let TouchpadInitializer finish */
+        QCoreApplication::processEvents();
+        QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+        deferred.time.stop();
+        deferred.round_trips += fake_device_counters().round_trips;
+    }
+
+    printf("%-12s %15s %10s\n", "step", "time", "trips");
+    print_step(open, iterations);
+    print_step(load, iterations);
+    print_step(save, iterations);
+    print_step(init, iterations);
+    print_step(deferred, iterations);
+
+    return 0;
+}
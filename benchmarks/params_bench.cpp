@@ -0,0 +1,153 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+/*
+ * Compares what touchpad-params does, reading every parameter in one pass
+ * and writing a batch of them in one transaction, with running a tool like
+ * synclient once per parameter, each run opening the device, reading or
+ * writing one parameter and closing it again. On the fake device, which
+ * counts the requests; KCM_TOUCHPAD_FAKE_LATENCY=<ms> slows its replies.
+ *
+ * Usage: params_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "touchpad.h"
+#include "touchpad_backend.h"
+#include "bench_util.h"
+
+struct Cost {
+    Stopwatch time;
+    unsigned long requests;
+    unsigned long round_trips;
+
+    Cost() : requests(0), round_trips(0) {}
+};
+
+static void
+start(Cost& cost, FakeDeviceCounters& counters)
+{
+    counters = fake_device_counters();
+    cost.time.start();
+}
+
+static void
+stop(Cost& cost, const FakeDeviceCounters& counters)
+{
+    cost.time.stop();
+    cost.requests += fake_device_counters().requests - counters.requests;
+    cost.round_trips += fake_device_counters().round_trips - counters.round_trips;
+}
+
+static void
+print(const char* name, const Cost& cost, int iterations)
+{
+    printf("%-16s %9.4f ms %10.1f %8.1f\n", name, cost.time.ms() / iterations,
+           (double)cost.requests / iterations,
+           (double)cost.round_trips / iterations);
+}
+
+int
+main(int argc, char** argv)
+{
+    int iterations = bench_count(argc, argv, 1, 100);
+
+    setenv("KCM_TOUCHPAD_BACKEND", "fake", 1);
+    fake_device_reset();
+
+    /* every parameter, and a state differing from the defaults in all
+     * writable ones */
+    param_values all, changed;
+    for (int j = 0; params[j].name; j++)
+        all[params[j].name] = 0;
+    if (Touchpad::init_xinput_extension() < 0) {
+        fprintf(stderr, "fake device unusable\n");
+        return 1;
+    }
+    Touchpad::get_parameters(all);
+    Touchpad::free_xinput_extension();
+    for (int j = 0; params[j].name; j++) {
+        param_values::const_iterator it = all.find(params[j].name);
+        if (it == all.end() || params[j].name[0] == '_')
+            continue;
+        double value = it->second + (params[j].type == PT_DOUBLE ? 0.01 : 1);
+        changed[it->first] = value <= params[j].max_val ? value : params[j].min_val;
+    }
+
+    Cost dump, each_get, batch, each_set;
+    FakeDeviceCounters counters;
+    int read = 0;
+    for (int i = 0; i < iterations; i++) {
+        fake_device_reset();
+        start(dump, counters);
+        Touchpad::init_xinput_extension();
+        param_values values = all;
+        read = Touchpad::get_parameters(values);
+        Touchpad::free_xinput_extension();
+        stop(dump, counters);
+
+        start(each_get, counters);
+        for (int j = 0; params[j].name; j++) {
+            if (!all.count(params[j].name))
+                continue;
+            Touchpad::init_xinput_extension();
+            double value;
+            Touchpad::get_parameter((ParamId)j, value);
+            Touchpad::free_xinput_extension();
+        }
+        stop(each_get, counters);
+
+        start(batch, counters);
+        Touchpad::init_xinput_extension();
+        Touchpad::Transaction transaction;
+        transaction.begin();
+        for (param_values::const_iterator it = changed.begin(); it != changed.end(); ++it)
+            transaction.set(it->first, it->second);
+        transaction.commit();
+        Touchpad::free_xinput_extension();
+        stop(batch, counters);
+
+        fake_device_reset();
+        start(each_set, counters);
+        for (param_values::const_iterator it = changed.begin(); it != changed.end(); ++it) {
+            Touchpad::init_xinput_extension();
+            Touchpad::set_parameter(it->first, it->second);
+            Touchpad::free_xinput_extension();
+        }
+        stop(each_set, counters);
+    }
+
+    printf("%-16s %12s %10s %8s\n", "", "time", "requests", "trips");
+    print("dump", dump, iterations);
+    print("get per process", each_get, iterations);
+    print("batch set", batch, iterations);
+    print("set per process", each_set, iterations);
+    printf("%d parameters read, %d written\n", read, (int)changed.size());
+
+    return 0;
+}
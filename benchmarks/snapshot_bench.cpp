@@ -0,0 +1,162 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+/*
+ * Compares putting a touchpad back into a saved state from a snapshot
+ * file, and from the state kept in memory the way ksyndaemon keeps it for
+ * re-initialized devices, with replaying the saved parameters one
+ * set_parameter() call each, as applying the saved configuration key by
+ * key does. All start from
+ * the driver defaults and end in the same state, on the fake device, which
+ * counts the requests; KCM_TOUCHPAD_FAKE_LATENCY=<ms> slows its replies.
+ *
+ * Usage: snapshot_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "touchpad.h"
+#include "touchpad_backend.h"
+#include "bench_util.h"
+
+static void
+apply(const param_values& values)
+{
+    Touchpad::Transaction transaction;
+    transaction.begin();
+    for (param_values::const_iterator it = values.begin(); it != values.end(); ++it)
+        transaction.set(it->first, it->second);
+    transaction.commit();
+}
+
+/* whether the device holds values, as floats like the properties */
+static bool
+reached(const param_values& values)
+{
+    param_values check = values;
+    Touchpad::get_parameters(check);
+    if (check.size() != values.size())
+        return false;
+    for (param_values::const_iterator it = values.begin(); it != values.end(); ++it)
+        if ((float)check[it->first] != (float)it->second)
+            return false;
+    return true;
+}
+
+int
+main(int argc, char** argv)
+{
+    int iterations = bench_count(argc, argv, 1, 1000);
+
+    char path[] = "/tmp/snapshot_bench.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    unlink(path);       /* save_snapshot() creates it */
+
+    setenv("KCM_TOUCHPAD_BACKEND", "fake", 1);
+    fake_device_reset();
+    if (Touchpad::init_xinput_extension() < 0) {
+        fprintf(stderr, "fake device unusable\n");
+        return 1;
+    }
+
+    /* the driver defaults, and a state different in every parameter */
+    param_values defaults, saved;
+    for (int j = 0; params[j].name; j++)
+        if (params[j].name[0] != '_')   /* read-only */
+            defaults[params[j].name] = 0;
+    Touchpad::get_parameters(defaults);
+    for (int j = 0; params[j].name; j++) {
+        param_values::const_iterator it = defaults.find(params[j].name);
+        if (it == defaults.end())
+            continue;
+        double value = it->second + (params[j].type == PT_DOUBLE ? 0.01 : 1);
+        saved[it->first] = value <= params[j].max_val ? value : params[j].min_val;
+    }
+
+    apply(saved);
+    if (!Touchpad::save_snapshot(path)) {
+        unlink(path);
+        return 1;
+    }
+
+    snapshot_properties state;
+    Touchpad::get_device_state(state);
+
+    Stopwatch snapshot, memory, replay;
+    unsigned long snapshot_requests = 0, memory_requests = 0, replay_requests = 0;
+    int restored = 0;
+    bool same = true;
+    for (int i = 0; i < iterations; i++) {
+        apply(defaults);
+        unsigned long requests = fake_device_counters().requests;
+        snapshot.start();
+        restored = Touchpad::restore_snapshot(path);
+        snapshot.stop();
+        snapshot_requests += fake_device_counters().requests - requests;
+        if (i == 0)
+            same = reached(saved);
+
+        apply(defaults);
+        requests = fake_device_counters().requests;
+        memory.start();
+        Touchpad::set_device_state(state);
+        memory.stop();
+        memory_requests += fake_device_counters().requests - requests;
+        if (i == 0)
+            same = same && reached(saved);
+
+        apply(defaults);
+        requests = fake_device_counters().requests;
+        replay.start();
+        for (param_values::const_iterator it = saved.begin(); it != saved.end(); ++it)
+            Touchpad::set_parameter(it->first, it->second);
+        replay.stop();
+        replay_requests += fake_device_counters().requests - requests;
+        if (i == 0)
+            same = same && reached(saved);
+    }
+
+    printf("%-10s %12s %10s\n", "restore", "time", "requests");
+    printf("%-10s %9.4f ms %10.1f\n", "snapshot",
+           snapshot.ms() / iterations, (double)snapshot_requests / iterations);
+    printf("%-10s %9.4f ms %10.1f\n", "memory",
+           memory.ms() / iterations, (double)memory_requests / iterations);
+    printf("%-10s %9.4f ms %10.1f\n", "replay",
+           replay.ms() / iterations, (double)replay_requests / iterations);
+    printf("%d properties, %d parameters, %s\n", restored, (int)saved.size(),
+           same ? "identical" : "DIFFERENT");
+
+    Touchpad::free_xinput_extension();
+    unlink(path);
+    return same ? 0 : 1;
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+/*
+ * Times D-Bus calls to ksyndaemon while it restarts a syndaemon which
+ * ignores SIGTERM, so every restart waits the full time before the kill.
+ * Calls must keep returning right away meanwhile; the exit status is 1
+ * if one took longer than the limit.
+ *
+ * ksyndaemon runs on a private session bus without a display, so it falls
+ * back to syndaemon, and finds a stand-in script first in its PATH, which
+ * logs each start. Needs dbus-daemon.
+ *
+ * Usage: syndaemon_bench [iterations [ksyndaemon]]
+ */
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QProcess>
+#include <QStringList>
+#include <QtDBus/QtDBus>
+
+#include <vector>
+
+#include "bench_util.h"
+
+#ifndef KSYNDAEMON_PATH
+#define KSYNDAEMON_PATH "ksyndaemon"
+#endif
+
+/* a call waiting this long was blocked by the restart */
+#define LATENCY_LIMIT_MS 250
+/* ksyndaemon kills syndaemon 3 s after SIGTERM */
+#define RESTART_MS 3500
+
+/* round trip of one call, -1 if it failed */
+static double
+timed_call(QDBusInterface& syndaemon, const char* method, const QVariant& arg = QVariant())
+{
+    Stopwatch call;
+    call.start();
+    QDBusMessage reply = arg.isValid() ? syndaemon.call(method, arg) : syndaemon.call(method);
+    double ms = call.stop();
+    if (reply.type() == QDBusMessage::ErrorMessage) {
+        fprintf(stderr, "%s: %s\n", method, qPrintable(reply.errorMessage()));
+        return -1;
+    }
+    return ms;
+}
+
+static double
+percentile(std::vector<double> samples, double fraction)
+{
+    if (samples.empty())
+        return 0;
+    std::sort(samples.begin(), samples.end());
+    return samples[(size_t)(fraction * (samples.size() - 1))];
+}
+
+static int
+count_lines(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+    return file.readAll().count('\n');
+}
+
+int
+main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    int iterations = bench_count(argc, argv, 1, 2);
+    QString program = QString::fromLocal8Bit(argc > 2 ? argv[2] : KSYNDAEMON_PATH);
+
+    char dir[] = "/tmp/syndaemon_bench.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    QString script = QString(dir) + "/syndaemon";
+    QString log = QString(dir) + "/starts";
+    QFile stand_in(script);
+    if (!stand_in.open(QIODevice::WriteOnly)) {
+        fprintf(stderr, "cannot write %s\n", qPrintable(script));
+        return 1;
+    }
+    stand_in.write(QString("#!/bin/sh\n"
+                           "echo \"$@\" >> '%1'\n"
+                           "trap '' TERM\n"
+                           "while :; do sleep 1; done\n").arg(log).toLocal8Bit());
+    stand_in.close();
+    stand_in.setPermissions(QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+
+    QProcess bus;
+    bus.start("dbus-daemon", QStringList() << "--session" << "--nofork" << "--print-address");
+    if (!bus.waitForReadyRead(5000)) {
+        fprintf(stderr, "cannot start dbus-daemon\n");
+        return 1;
+    }
+    QString address = QString::fromLocal8Bit(bus.readLine()).trimmed();
+
+    QStringList environment = QProcess::systemEnvironment();
+    environment = environment.filter(QRegExp("^(?!DISPLAY=|DBUS_SESSION_BUS_ADDRESS=|PATH=|KCM_TOUCHPAD_BACKEND=)"));
+    environment << "DBUS_SESSION_BUS_ADDRESS=" + address
+                << "PATH=" + QString(dir) + ":" + QString::fromLocal8Bit(qgetenv("PATH"));
+    QProcess ksyndaemon;
+    ksyndaemon.setEnvironment(environment);
+    ksyndaemon.setProcessChannelMode(QProcess::ForwardedChannels);
+    ksyndaemon.start(program, QStringList() << "--nofork");
+
+    QDBusConnection connection = QDBusConnection::connectToBus(address, "syndaemon_bench");
+    double deadline = now_ms() + 10000;
+    while (connection.isConnected() && now_ms() < deadline &&
+           !connection.interface()->isServiceRegistered("org.kde.ksyndaemon"))
+        usleep(50000);
+    if (!connection.isConnected() ||
+        !connection.interface()->isServiceRegistered("org.kde.ksyndaemon")) {
+        fprintf(stderr, "%s did not come up\n", qPrintable(program));
+        ksyndaemon.kill();
+        bus.kill();
+        return 1;
+    }
+    QDBusInterface syndaemon("org.kde.ksyndaemon", "/Syndaemon", "org.kde.KSyndaemon", connection);
+
+    std::vector<double> restart, during;
+    int failed = 0;
+    if (timed_call(syndaemon, "startMonitoring") < 0)
+        failed++;
+    for (int i = 0; i < iterations && !failed; i++) {
+        /* another interval restarts syndaemon, which ignores SIGTERM */
+        double ms = timed_call(syndaemon, "setInterval", (uint)(2000 + i % 2 * 1000));
+        if (ms < 0) {
+            failed++;
+            break;
+        }
+        restart.push_back(ms);
+
+        /* and the restart is under way until the kill */
+        double end = now_ms() + RESTART_MS;
+        while (now_ms() < end) {
+            ms = timed_call(syndaemon, "setInterval", (uint)(2000 + i % 2 * 1000));
+            double again = timed_call(syndaemon, "startMonitoring");
+            if (ms < 0 || again < 0) {
+                failed++;
+                break;
+            }
+            during.push_back(ms);
+            during.push_back(again);
+            usleep(20000);
+        }
+    }
+    double stop = timed_call(syndaemon, "stopMonitoring");
+    if (stop < 0)
+        failed++;
+
+    printf("%-22s %6s %10s %10s %10s\n", "call", "calls", "median", "p99", "max");
+    printf("%-22s %6d %7.3f ms %7.3f ms %7.3f ms\n", "setInterval (restart)", (int)restart.size(),
+           percentile(restart, 0.5), percentile(restart, 0.99), percentile(restart, 1));
+    printf("%-22s %6d %7.3f ms %7.3f ms %7.3f ms\n", "during restart", (int)during.size(),
+           percentile(during, 0.5), percentile(during, 0.99), percentile(during, 1));
+    printf("%-22s %6d %7.3f ms\n", "stopMonitoring", 1, stop);
+    printf("syndaemon started %d times\n", count_lines(log));
+
+    double worst = std::max(percentile(restart, 1), std::max(percentile(during, 1), stop));
+    if (worst > LATENCY_LIMIT_MS) {
+        fprintf(stderr, "a call took %.1f ms, over %d ms\n", worst, LATENCY_LIMIT_MS);
+        failed++;
+    }
+
+    ksyndaemon.terminate();
+    if (!ksyndaemon.waitForFinished(5000))
+        ksyndaemon.kill();
+    bus.kill();
+    bus.waitForFinished();
+    QFile::remove(script);
+    QFile::remove(log);
+    rmdir(dir);
+
+    return failed ? 1 : 0;
+}
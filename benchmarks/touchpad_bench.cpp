@@ -0,0 +1,236 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+/*
+ * Times the touchpad property calls with each backend: init_xinput_extension(),
+ * a full fetch of every synaptics property and writing them all back, both
+ * straight through the backend and waited for with a round trip, then
+ * single get_parameter() calls, answered from the property mirror, and
+ * set_parameter() calls, of which only the sending is timed. Written values
+ * are the ones read, so the device configuration is left untouched.
+ *
+ * The "fake" backend needs no X server; it also counts round trips, and
+ * KCM_TOUCHPAD_FAKE_LATENCY=<ms> makes each of them that slow.
+ *
+ * Usage: touchpad_bench [iterations [backend...]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "touchpad.h"
+#include "touchpad_backend.h"
+#include "bench_util.h"
+
+/* Time and round trips per call of one operation */
+struct Timing {
+    double ms;
+    double round_trips;     /* -1 when unknown */
+};
+
+static bool counting;
+static Stopwatch stopwatch;
+static FakeDeviceCounters start_counters;
+
+static void
+timing_start()
+{
+    stopwatch.start();
+    if (counting)
+        start_counters = fake_device_counters();
+}
+
+static Timing
+timing_stop(int calls)
+{
+    Timing t;
+    t.ms = stopwatch.stop() / calls;
+    t.round_trips = counting ?
+        (double)(fake_device_counters().round_trips - start_counters.round_trips) / calls : -1;
+    return t;
+}
+
+static void
+print_timing(const char* requested, const char* operation, const Timing& t)
+{
+    if (t.round_trips < 0)
+        printf("%-8s %-8s %12.4f ms %10s\n", requested, operation, t.ms, "-");
+    else
+        printf("%-8s %-8s %12.4f ms %10.1f\n", requested, operation, t.ms, t.round_trips);
+}
+
+/*
+ * A backend of the requested kind on a connection of our own, for the
+ * current device, with the atoms of all synaptics properties. The
+ * mirror of the Touchpad namespace would answer reads without asking.
+ */
+static PropertyBackend*
+open_backend(const char* requested, Display** dpy, XDevice** dev, std::vector<Atom>& atoms)
+{
+    std::vector<char*> names;
+    for (int j = 0; params[j].name; j++) {
+        size_t k = 0;
+        while (k < names.size() && strcmp(names[k], params[j].prop_name))
+            k++;
+        if (k == names.size())
+            names.push_back((char*)params[j].prop_name);
+    }
+    atoms.resize(names.size());
+
+    *dpy = NULL;
+    *dev = NULL;
+    if (!strcmp(requested, "fake")) {
+        fake_intern_atoms(&names[0], names.size(), &atoms[0]);
+        return create_fake_backend();
+    }
+
+    *dpy = XOpenDisplay(NULL);
+    if (!*dpy)
+        return NULL;
+    XInternAtoms(*dpy, &names[0], names.size(), True, &atoms[0]);
+    *dev = XOpenDevice(*dpy, Touchpad::get_current_device());
+    if (!*dev) {
+        XCloseDisplay(*dpy);
+        return NULL;
+    }
+    /* like touchpad.cpp, xlib stands in for xcb where it is missing */
+#ifdef HAVE_XCB_XINPUT
+    if (!strcmp(requested, "xcb"))
+        return create_xcb_backend(*dpy, *dev);
+#endif
+    return create_xlib_backend(*dpy, *dev);
+}
+
+static int
+bench_backend(const char* requested, int iterations)
+{
+    setenv("KCM_TOUCHPAD_BACKEND", requested, 1);
+    counting = !strcmp(requested, "fake");
+    if (counting)
+        fake_device_reset();
+
+    timing_start();
+    for (int i = 0; i < iterations; i++) {
+        if (Touchpad::init_xinput_extension() < 0) {
+            Touchpad::free_xinput_extension();
+            return -1;
+        }
+        Touchpad::free_xinput_extension();
+    }
+    Timing init = timing_stop(iterations);
+
+    Touchpad::init_xinput_extension();
+
+    Display* dpy;
+    XDevice* dev;
+    std::vector<Atom> atoms;
+    PropertyBackend* backend = open_backend(requested, &dpy, &dev, atoms);
+    if (!backend) {
+        Touchpad::free_xinput_extension();
+        return -1;
+    }
+    /* properties the server does not know are never asked for */
+    atoms.erase(std::remove(atoms.begin(), atoms.end(), (Atom)None), atoms.end());
+    std::vector<long> lengths(atoms.size(), 1000);
+    std::vector<PropertyData> props;
+    const char* name = backend->name();
+
+    timing_start();
+    for (int i = 0; i < iterations; i++)
+        backend->get_properties(atoms, lengths, props);
+    Timing load = timing_stop(iterations);
+
+    /* the device's own values, only of the properties it has */
+    std::vector<Atom> present;
+    std::vector<PropertyData> current;
+    for (size_t j = 0; j < atoms.size(); j++)
+        if (props[j].type != None) {
+            present.push_back(atoms[j]);
+            current.push_back(props[j]);
+        }
+
+    timing_start();
+    for (int i = 0; i < iterations; i++)
+        backend->change_properties(present, current);
+    /* writes are asynchronous, wait for the server to process them; the
+     * fake device handles them right away */
+    if (dpy)
+        XSync(dpy, False);
+    Timing apply = timing_stop(iterations);
+
+    delete backend;
+    if (dpy) {
+        XCloseDevice(dpy, dev);
+        XCloseDisplay(dpy);
+    }
+
+    timing_start();
+    for (int i = 0; i < iterations; i++)
+        for (int j = 0; j < PARAM_COUNT; j++)
+            Touchpad::get_int((ParamId)j);
+    Timing get = timing_stop(iterations * PARAM_COUNT);
+
+    int off = Touchpad::get_int(P_TOUCHPAD_OFF, 0);
+    timing_start();
+    for (int i = 0; i < iterations; i++)
+        Touchpad::set_parameter(P_TOUCHPAD_OFF, off);
+    Timing set = timing_stop(iterations);
+
+    printf("%s: %s\n", requested, name);
+    print_timing(requested, "init", init);
+    print_timing(requested, "load", load);
+    print_timing(requested, "apply", apply);
+    print_timing(requested, "get", get);
+    print_timing(requested, "set", set);
+
+    Touchpad::free_xinput_extension();
+    return 0;
+}
+
+int
+main(int argc, char** argv)
+{
+    static const char* all_backends[] = { "xlib", "xcb", "fake" };
+
+    int iterations = bench_count(argc, argv, 1, 100);
+
+    const char** backends = argc > 2 ? (const char**)argv + 2 : all_backends;
+    int nbackends = argc > 2 ? argc - 2 : 3;
+
+    printf("%-8s %-8s %15s %10s\n", "request", "call", "time", "trips");
+    int failed = 0;
+    for (int j = 0; j < nbackends; j++) {
+        if (bench_backend(backends[j], iterations) < 0) {
+            fprintf(stderr, "%s: no usable synaptics touchpad.\n", backends[j]);
+            failed++;
+        }
+    }
+
+    return failed == nbackends ? 1 : 0;
+}
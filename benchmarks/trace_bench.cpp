@@ -0,0 +1,121 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+/*
+ * Measures the cost of tracing: queueing a synthetic finger stroke in the
+ * ring, writing it to a trace file and reading it back, per event, and the
+ * bytes an event takes in the file. The read back events are compared
+ * with the generated ones.
+ *
+ * Usage: trace_bench [events [file]]
+ */
+
+#include <sys/stat.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "touchpad_trace.h"
+#include "bench_util.h"
+
+/* A finger circling at 80 Hz, tapping every 200 events */
+static TraceEvent
+stroke(long i)
+{
+    TraceEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.time = 1000 + i * 12;
+    ev.type = TRACE_MOTION;
+    if (i % 200 == 198 || i % 200 == 199) {
+        ev.type = i % 200 == 198 ? TRACE_BUTTON_PRESS : TRACE_BUTTON_RELEASE;
+        ev.button = 1;
+    }
+    ev.values[TRACE_X] = 3000 + (int)(1500 * cos(i / 50.0));
+    ev.values[TRACE_Y] = 2500 + (int)(1000 * sin(i / 50.0));
+    ev.values[TRACE_PRESSURE] = 40 + (int)(i % 7);
+    ev.values[TRACE_WIDTH] = 4;
+    return ev;
+}
+
+int
+main(int argc, char** argv)
+{
+    long events = bench_count(argc, argv, 1, 1000000);
+    const char* path = argc > 2 ? argv[2] : "/tmp/trace_bench.trace";
+
+    TraceRing ring(4096);
+    TraceWriter writer;
+    TraceEvent ev;
+    if (!writer.open(path, "trace_bench", (1 << TRACE_VALUATORS) - 1))
+        return 1;
+
+    /* what ksyndaemon does: queue as events come, drain now and then */
+    static TraceEvent batch[1024];
+    Stopwatch queued, written, reading;
+    for (long i = 0; i < events; ) {
+        int count = 0;
+        for (; count < 1024 && i < events; count++, i++)
+            batch[count] = stroke(i);
+
+        queued.start();
+        for (int j = 0; j < count; j++)
+            ring.push(batch[j]);
+        queued.stop();
+
+        written.start();
+        while (ring.pop(ev))
+            writer.write(ev);
+        written.stop();
+    }
+    written.start();
+    writer.close();
+    written.stop();
+
+    struct stat st;
+    stat(path, &st);
+
+    TraceReader reader;
+    if (!reader.open(path))
+        return 1;
+    long read = 0, mismatches = 0;
+    reading.start();
+    while (reader.next(ev) == 1) {
+        TraceEvent expected = stroke(read++);
+        if (ev.time != expected.time || ev.type != expected.type ||
+            ev.button != expected.button ||
+            memcmp(ev.values, expected.values, sizeof(ev.values)))
+            mismatches++;
+    }
+    reading.stop();
+
+    printf("%-10s %10.1f ns/event\n", "queue", queued.ms() * 1e6 / events);
+    printf("%-10s %10.1f ns/event\n", "write", written.ms() * 1e6 / events);
+    printf("%-10s %10.1f ns/event\n", "read", reading.ms() * 1e6 / events);
+    printf("%-10s %10.2f bytes/event\n", "size", (double)st.st_size / events);
+    printf("%ld of %ld events read back, %ld differ\n", read, events, mismatches);
+
+    return read == events && !mismatches ? 0 : 1;
+}
@@ -24,9 +24,14 @@
  */
 
 #include <QCheckBox>
+#include <QComboBox>
+#include <QFileInfo>
 #include <QSlider>
 #include <QGroupBox>
 #include <QLabel>
+#include <QRadioButton>
+#include <QTime>
+#include <QTimer>
 
 #include <KButtonGroup>
 #include <KApplication>
@@ -37,6 +42,7 @@
 #include <KPluginLoader>
 #include <KMessageBox>
 #include <KLocalizedString>
+#include <KDebug>
 
 #include <math.h>
 
@@ -44,6 +50,8 @@
 #include "ui_kcmtouchpadwidget.h"
 
 #include "touchpad.h"
+#include "touchpadclient.h"
+#include "touchpad_calibrate.h"
 
 K_PLUGIN_FACTORY(TouchpadConfigFactory, registerPlugin<TouchpadConfig>("touchpad");)
 K_EXPORT_PLUGIN(TouchpadConfigFactory("kcmtouchpad"))
@@ -51,33 +59,303 @@ K_EXPORT_PLUGIN(TouchpadConfigFactory("kcmtouchpad"))
 // The slider is in degrees, but config and touchpad is in radians
 static const double ScrollCircularScale = 180.0/M_PI;
 
+// How long "Calibrate" collects positions, in ms
+static const int CalibrationTime = 5000;
+
+/*
+ * How the dialog shows the driver parameters. One table tells load(),
+ * save(), apply(), refreshWidgets() and applySavedConfig() which widget
+ * shows which parameter, under which configuration key (the parameter's
+ * name) and whether it exists, from the parameter's property; each of
+ * them sends or fetches all values in one batch.
+ *
+ * Widgets hold settings, the values kept in the configuration. Those are
+ * the driver's values except for the touch sensitivity.
+ */
+enum BindingKind {
+    CheckBinding,       // checked when non-zero, scale when checked
+    SliderBinding,      // the value times scale
+    ComboBinding,       // index of the current item
+    OffBinding,         // widget: "off", partner: "allow moving" (1 / 2)
+    SensitivityBinding, // a tenth of FingerLow, also sets FingerHigh
+    CoastingBinding,    // widget: check box, partner: slider (times scale)
+    ButtonBinding       // tap: its row in tappingButtonsMap
+};
+
+struct SettingBinding {
+    const char* parameter;
+    BindingKind kind;
+    const char* widget;
+    const char* partner;
+    double scale;
+    int tap;                    // Synaptics::TapType, -1 unless ButtonBinding
+    int group;                  // TouchpadConfig::SettingsGroup
+    const char* requires;       // a property the widget needs besides
+};
+
+static const int Essential = TouchpadConfig::EssentialSettings;
+static const int Other = TouchpadConfig::OtherSettings;
+
+static const SettingBinding bindings[] = {
+    { "TouchpadOff", OffBinding, "TouchpadOffRB", "TouchpadOffWOMoveCB", 1, -1, Essential, NULL },
+    { "FingerLow", SensitivityBinding, "SensitivityValueS", NULL, 1, -1, Other, NULL },
+    { "VertEdgeScroll", CheckBinding, "ScrollVertEnableCB", NULL, 1, -1, Other, NULL },
+    { "HorizEdgeScroll", CheckBinding, "ScrollHorizEnableCB", NULL, 1, -1, Other, NULL },
+    { "CornerCoasting", CheckBinding, "ScrollCoastingCornerEnableCB", NULL, 1, -1, Other, SYNAPTICS_PROP_COASTING_SPEED },
+    { "VertScrollDelta", SliderBinding, "ScrollVertSpeedS", NULL, 1, -1, Other, NULL },
+    { "HorizScrollDelta", SliderBinding, "ScrollHorizSpeedS", NULL, 1, -1, Other, NULL },
+    { "VertTwoFingerScroll", CheckBinding, "ScrollVertTFEnableCB", NULL, 1, -1, Other, NULL },
+    { "HorizTwoFingerScroll", CheckBinding, "ScrollHorizTFEnableCB", NULL, 1, -1, Other, NULL },
+    { "CoastingSpeed", CoastingBinding, "ScrollCoastingEnableCB", "ScrollCoastingSpeedS", 100, -1, Other, NULL },
+    { "CircularScrolling", CheckBinding, "ScrollCircularEnableCB", NULL, 1, -1, Other, NULL },
+    { "CircScrollDelta", SliderBinding, "ScrollCircularSpeedS", NULL, ScrollCircularScale, -1, Other, NULL },
+    { "CircScrollTrigger", ComboBinding, "ScrollCircularCornersCBB", NULL, 1, -1, Other, NULL },
+    { "MaxTapTime", CheckBinding, "TappingEnableCB", NULL, 180, -1, Essential, NULL },
+    { "MaxTapMove", SliderBinding, "TappingMaxMoveValueS", NULL, 1, -1, Essential, NULL },
+    { "SingleTapTimeout", SliderBinding, "TappingTimeoutValueS", NULL, 1, -1, Essential, NULL },
+    { "MaxDoubleTapTime", SliderBinding, "TappingDoubleTimeValueS", NULL, 1, -1, Essential, NULL },
+    { "ClickTime", SliderBinding, "TappingClickTimeValueS", NULL, 1, -1, Essential, NULL },
+    { "TapButton1", ButtonBinding, NULL, NULL, 1, Synaptics::OneFinger, Essential, NULL },
+    { "TapButton2", ButtonBinding, NULL, NULL, 1, Synaptics::TwoFingers, Essential, NULL },
+    { "TapButton3", ButtonBinding, NULL, NULL, 1, Synaptics::ThreeFingers, Essential, NULL },
+    { "RTCornerButton", ButtonBinding, NULL, NULL, 1, Synaptics::RightTop, Essential, NULL },
+    { "RBCornerButton", ButtonBinding, NULL, NULL, 1, Synaptics::RightBottom, Essential, NULL },
+    { "LTCornerButton", ButtonBinding, NULL, NULL, 1, Synaptics::LeftTop, Essential, NULL },
+    { "LBCornerButton", ButtonBinding, NULL, NULL, 1, Synaptics::LeftBottom, Essential, NULL },
+    { NULL, CheckBinding, NULL, NULL, 0, -1, 0, NULL }
+};
+
+// Driver parameters set by calibration, saved only once calibrated
+static const char* const edgeParameters[] = {
+    "LeftEdge", "RightEdge", "TopEdge", "BottomEdge",
+    "AreaLeftEdge", "AreaRightEdge", "AreaTopEdge", "AreaBottomEdge",
+    NULL
+};
+
+/*
+ * Settings of a device live in a subgroup of "Touchpad" named after it.
+ * Devices without settings of their own use the "Touchpad" group itself,
+ * where everything was kept before multiple devices were supported.
+ * Settings not bound to a device (smart mode) stay in "Touchpad".
+ */
+static KConfigGroup deviceConfig(KSharedConfigPtr config, const QString& deviceName, bool forWriting = false)
+{
+    KConfigGroup touchpad(config, "Touchpad");
+    if (deviceName.isEmpty())
+        return touchpad;
+
+    KConfigGroup device(&touchpad, deviceName);
+    return (forWriting || device.exists()) ? device : touchpad;
+}
+
+/*
+ * The driver state of the devices as save() left it, put back at startup
+ * unless the configuration changed after it was taken.
+ */
+static QString snapshotPath()
+{
+    return KStandardDirs::locateLocal("data", "kcm_touchpad/snapshot");
+}
+
+static bool snapshotCurrent()
+{
+    QFileInfo snapshot(snapshotPath());
+    QFileInfo config(KStandardDirs::locateLocal("config", "kcmtouchpadrc"));
+    return snapshot.exists() && (!config.exists() || snapshot.lastModified() >= config.lastModified());
+}
+
+/*
+ * Name of the property holding the driver parameter.
+ */
+static const char* propertyName(const char* parameter)
+{
+    for (int j = 0; params[j].name; j++)
+        if (!strcasecmp(params[j].name, parameter))
+            return params[j].prop_name;
+    return "";
+}
+
+/*
+ * Calibrated edges the device has properties for, read from config.
+ */
+static param_values savedEdges(const KConfigGroup& config, const QSet<QString>& properties)
+{
+    param_values edges;
+    for (int i = 0; edgeParameters[i]; i++) {
+        if (properties.contains(propertyName(edgeParameters[i])) && config.hasKey(edgeParameters[i]))
+            edges[edgeParameters[i]] = config.readEntry(edgeParameters[i], -1);
+    }
+    return edges;
+}
+
+/*
+ * Whether the device has what the widget of binding needs.
+ */
+static bool isBound(const SettingBinding& binding, const QSet<QString>& properties)
+{
+    return properties.contains(propertyName(binding.parameter)) &&
+        (!binding.requires || properties.contains(binding.requires));
+}
+
+/*
+ * Whether the widgets binding names are in the form, with the types
+ * widgetSetting() and showSetting() look them up as.
+ */
+static bool isResolved(const SettingBinding& binding, const QWidget* form)
+{
+    switch (binding.kind) {
+    case CheckBinding:
+        return form->findChild<QCheckBox*>(binding.widget);
+    case SliderBinding:
+    case SensitivityBinding:
+        return form->findChild<QSlider*>(binding.widget);
+    case ComboBinding:
+        return form->findChild<QComboBox*>(binding.widget);
+    case OffBinding:
+        return form->findChild<QRadioButton*>(binding.widget) &&
+            form->findChild<QCheckBox*>(binding.partner);
+    case CoastingBinding:
+        return form->findChild<QCheckBox*>(binding.widget) &&
+            form->findChild<QSlider*>(binding.partner);
+    case ButtonBinding:
+        return binding.tap >= 0 && binding.tap < Synaptics::MAX_TAP;
+    }
+    return false;
+}
+
+/*
+ * Adds the driver parameters of binding to values, to be fetched.
+ */
+static void addParameters(const SettingBinding& binding, param_values& values)
+{
+    values[binding.parameter] = 0;
+    if (binding.kind == SensitivityBinding)
+        values["FingerHigh"] = 0;
+}
+
+/*
+ * The setting shown for the driver values of binding's parameters.
+ */
+static double driverSetting(const SettingBinding& binding, const param_values& driver)
+{
+    param_values::const_iterator it = driver.find(binding.parameter);
+    double value = it != driver.end() ? it->second : 0;
+    return binding.kind == SensitivityBinding ? (int)value / 10 : value;
+}
+
+/*
+ * The driver values of binding's parameters for setting, into values.
+ */
+static void putSetting(param_values& values, const SettingBinding& binding, double setting)
+{
+    if (binding.kind != SensitivityBinding) {
+        values[binding.parameter] = setting;
+        return;
+    }
+
+    // The driver (hardware?) refuses out of order limits (i.e. the upper
+    // one below the lower one and vice versa), but both share a property
+    // and are sent in one batch, so only the final pair is checked.
+    values["FingerLow"] = setting * 10 + 1;
+    values["FingerHigh"] = setting * 10 + 6;
+}
+
+static param_values shownDriverValues(TouchpadClient* client)
+{
+    param_values driver;
+    for (const SettingBinding* binding = bindings; binding->parameter; binding++)
+        addParameters(*binding, driver);
+    for (int i = 0; edgeParameters[i]; i++)
+        driver[edgeParameters[i]] = 0;
+    client->getParameters(driver);
+    return driver;
+}
+
+/*
+ * Driver values of the shown parameters the configuration has no entry
+ * for, fetched in one pass. A configured device needs no reads at all.
+ */
+static param_values unconfiguredDriverValues(TouchpadClient* client, const KConfigGroup& config)
+{
+    param_values driver;
+    for (const SettingBinding* binding = bindings; binding->parameter; binding++) {
+        if (!config.hasKey(binding->parameter))
+            addParameters(*binding, driver);
+    }
+    for (int i = 0; edgeParameters[i]; i++) {
+        if (!config.hasKey(edgeParameters[i]))
+            driver[edgeParameters[i]] = 0;
+    }
+    if (!driver.empty())
+        client->getParameters(driver);
+    return driver;
+}
+
 TouchpadConfig::TouchpadConfig(QWidget *parent, const QVariantList &)
         : KCModule(TouchpadConfigFactory::componentData(), parent),
-	setup_failed(false)
+	appliedSmartMode(false),
+	appliedSmartModeDelay(0),
+	previewed(false),
+	previewDevice(-1),
+	setup_failed(false),
+	refreshing(false),
+	pendingChanges(false)
 {
     // Load translations
     KGlobal::locale()->insertCatalog("kcm_touchpad");
 
-    int returnValue = Touchpad::init_xinput_extension();
-
-    const prop_list* properties_list = Touchpad::get_properties_list();
-    if (properties_list)
-        for (prop_list::const_iterator it = properties_list->begin(); it != properties_list->end(); it++) {
-            this->propertiesList.insert(*it);
-        }
+    // ksyndaemon's touchpad service if it runs, the display otherwise
+    client = new TouchpadClient(this);
+    int returnValue = client->open();
+    this->propertiesList = client->deviceProperties();
 
     // set user interface
     ui = new Ui_TouchpadConfigWidget();
     ui->setupUi(this);
 
+    // widgets are looked up by name from here on; a widget renamed or
+    // removed in kcmtouchpadwidget.ui stops the module right here
+    for (const SettingBinding* binding = bindings; binding->parameter; binding++) {
+        if (!isResolved(*binding, this))
+            qFatal("kcm_touchpad: no widget for %s in kcmtouchpadwidget.ui", binding->parameter);
+    }
+
     if (returnValue >= 0) {
-        ui->DeviceNameValueL->setText(Touchpad::get_device_name());
+        this->updateDeviceList();
         this->enableProperties();
+
+        // follow property changes made by other clients, e.g. syndaemon
+        connect(client, SIGNAL(parametersChanged(const QSet<QString>&)),
+                this, SLOT(touchpadPropertiesChanged(const QSet<QString>&)));
+        connect(client, SIGNAL(devicesChanged(const QList<int>&, const QList<int>&)),
+                this, SLOT(touchpadDevicesChanged(const QList<int>&, const QList<int>&)));
+        client->watch();
     }
     else
         setup_failed = true;
 
+    // live preview writes at most once per 16 ms, the latest values
+    previewTimer.setSingleShot(true);
+    previewTimer.setInterval(16);
+    connect(&previewTimer, SIGNAL(timeout()), this, SLOT(previewChanges()));
+
+    // tap delay figures follow the taps twice a second
+    tapDelayTimer.setInterval(500);
+    connect(&tapDelayTimer, SIGNAL(timeout()), this, SLOT(showTapDelay()));
+
+    // calibration shows its progress twice a second too
+    calibrationTimer.setInterval(500);
+    connect(&calibrationTimer, SIGNAL(timeout()), this, SLOT(calibrationProgress()));
+
+    // the heatmap takes the touches at most 25 times a second
+    heatmapTimer.setInterval(40);
+    connect(&heatmapTimer, SIGNAL(timeout()), this, SLOT(showHeatmap()));
+
     // we have to connect widgets to corresponding slots
+    // "Apply changes immediately" check box
+    connect(ui->LivePreviewCB, SIGNAL(toggled(bool)), this, SLOT(livePreviewEnabled(bool)));
+    // "Configure Touchpad" combo box
+    connect(ui->DeviceSelectCBB, SIGNAL(activated(int)), this, SLOT(deviceSelected(int)));
     // "Touchpad On" radio button
     connect(ui->TouchpadOnRB, SIGNAL(toggled(bool)), this, SLOT(touchpadEnabled(bool)));
     // "Touchpad Allow Moving" check box
@@ -88,6 +366,10 @@ TouchpadConfig::TouchpadConfig(QWidget *parent, const QVariantList &)
 
     // "Touch Sensitivity" slider
     connect(ui->SensitivityValueS, SIGNAL(valueChanged(int)), this, SLOT(sensitivityValueChanged(int)));
+    // "Calibrate" push button
+    connect(ui->CalibrateB, SIGNAL(toggled(bool)), this, SLOT(calibrationToggled(bool)));
+    // "Record Touch Density" check box
+    connect(ui->HeatmapRecordCB, SIGNAL(toggled(bool)), this, SLOT(heatmapRecorded(bool)));
 
     // "Scrolling Vertical Enabled" check box
     connect(ui->ScrollVertEnableCB, SIGNAL(toggled(bool)), this, SLOT(scrollVerticalEnabled(bool)));
@@ -131,57 +413,156 @@ TouchpadConfig::TouchpadConfig(QWidget *parent, const QVariantList &)
     connect(ui->TappingEventLW, SIGNAL(currentRowChanged(int)), this, SLOT(tappingEventListSelected(int)));
     // "Corresponding Button" list widget
     connect(ui->TappingButtonLW, SIGNAL(currentRowChanged(int)), this, SLOT(tappingButtonListSelected(int)));
+    // "Measure Tap Delay" check box
+    connect(ui->TapDelayMeasureCB, SIGNAL(toggled(bool)), this, SLOT(tapDelayMeasured(bool)));
 }
 
 TouchpadConfig::~TouchpadConfig()
 {
-    Touchpad::free_xinput_extension();
+    // closed without saving
+    revertPreview();
+    client->close();
     delete(ui);
     ui = NULL;
 }
 
-void TouchpadConfig::enableProperties() {
-    if (this->propertiesList.contains(SYNAPTICS_PROP_OFF)) {
-        ui->TouchpadOnRB->setEnabled(true);
-        ui->TouchpadOffRB->setEnabled(true);
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_FINGER)) {
-        ui->SensitivityLowL->setEnabled(true);
-        ui->SensitivityValueS->setEnabled(true);
-        ui->SensitivityHighL->setEnabled(true);
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_SCROLL_EDGE)) {
-        ui->ScrollVertEnableCB->setEnabled(true);
-        ui->ScrollHorizEnableCB->setEnabled(true);
-        if (this->propertiesList.contains(SYNAPTICS_PROP_COASTING_SPEED)) {
-            ui->ScrollCoastingCornerEnableCB->setEnabled(true);
-        }
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_SCROLL_TWOFINGER) &&
-	 Touchpad::capability("_CapTwoFingers")) {
-        ui->ScrollVertTFEnableCB->setEnabled(true);
-        ui->ScrollHorizTFEnableCB->setEnabled(true);
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_COASTING_SPEED)) {
-        ui->ScrollCoastingEnableCB->setEnabled(true);
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_CIRCULAR_SCROLLING)) {
-        ui->ScrollCircularEnableCB->setEnabled(true);
+/*
+ * Fills the device selector. It is shown only when there is a choice.
+ */
+void TouchpadConfig::updateDeviceList() {
+    QList<int> devices = client->devices();
+
+    ui->DeviceSelectCBB->clear();
+    foreach (int id, devices) {
+        ui->DeviceSelectCBB->addItem(client->deviceName(id), id);
+        if (id == client->currentDevice())
+            ui->DeviceSelectCBB->setCurrentIndex(ui->DeviceSelectCBB->count() - 1);
     }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_TAP_TIME)) {
-        ui->TappingEnableCB->setEnabled(true);
+    ui->DeviceSelectL->setVisible(devices.size() > 1);
+    ui->DeviceSelectCBB->setVisible(devices.size() > 1);
+
+    if (!client->deviceName().isEmpty())
+        ui->DeviceNameValueL->setText(client->deviceName());
+    else
+        ui->DeviceNameValueL->setText(i18n("Device not found"));
+}
+
+/*
+ * Switches the dialog to another device, showing its settings. Changes
+ * made to the shown device are applied or dropped as the user says.
+ */
+void TouchpadConfig::deviceSelected(int index) {
+    int id = ui->DeviceSelectCBB->itemData(index).toInt();
+    if (id == client->currentDevice() || !client->devices().contains(id))
+        return;
+
+    if (pendingChanges) {
+        int answer = KMessageBox::warningYesNoCancel(this,
+            i18n("The settings of %1 have been changed.\n"
+                 "Do you want to apply them before switching to %2?",
+                 client->deviceName(), client->deviceName(id)),
+            i18n("Switch Touchpad"), KStandardGuiItem::apply(), KStandardGuiItem::discard());
+        if (answer == KMessageBox::Cancel) {
+            ui->DeviceSelectCBB->setCurrentIndex(ui->DeviceSelectCBB->findData(client->currentDevice()));
+            return;
+        }
+        if (answer == KMessageBox::Yes)
+            save();
     }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_TAP_ACTION)) {
-        ui->TappingButtonLW->setEnabled(true);
-	/* Do not offer events Touchpad does not claim to support */
-	if (!Touchpad::capability("_CapTwoFingers"))
-	    ui->TappingEventLW->item(Synaptics::TwoFingers)->setHidden(true);
-	if (!Touchpad::capability("_CapThreeFingers"))
-	    ui->TappingEventLW->item(Synaptics::ThreeFingers)->setHidden(true);
-        ui->TappingEventLW->setEnabled(true);
-        ui->ButtonTappingL->setEnabled(true);
-        ui->ButtonMeansL->setEnabled(true);
+    // unplugged while the question was open
+    if (!client->selectDevice(id)) {
+        updateDeviceList();
+        return;
     }
+
+    ui->DeviceNameValueL->setText(client->deviceName());
+    this->propertiesList = client->deviceProperties();
+    this->load();
+    this->enableProperties();
+    emit KCModule::changed(false);
+
+    // measure the device now shown
+    if (ui->TapDelayMeasureCB->isChecked())
+        tapDelayMeasured(true);
+    if (ui->HeatmapRecordCB->isChecked())
+        heatmapRecorded(true);
+}
+
+/*
+ * Enables the widgets of the properties the shown device has and disables
+ * the others, then lets the widgets depending on check boxes follow them.
+ */
+void TouchpadConfig::enableProperties() {
+    bool off = this->propertiesList.contains(SYNAPTICS_PROP_OFF);
+    ui->TouchpadOnRB->setEnabled(off);
+    ui->TouchpadOffRB->setEnabled(off);
+
+    bool finger = this->propertiesList.contains(SYNAPTICS_PROP_FINGER);
+    ui->SensitivityLowL->setEnabled(finger);
+    ui->SensitivityValueS->setEnabled(finger);
+    ui->SensitivityHighL->setEnabled(finger);
+
+    bool edges = this->propertiesList.contains(SYNAPTICS_PROP_EDGES);
+    ui->CalibrateB->setEnabled(edges);
+    ui->EdgesValueL->setEnabled(edges);
+    ui->HeatmapRecordCB->setEnabled(edges);
+
+    bool edgeScroll = this->propertiesList.contains(SYNAPTICS_PROP_SCROLL_EDGE);
+    ui->ScrollVertEnableCB->setEnabled(edgeScroll);
+    ui->ScrollHorizEnableCB->setEnabled(edgeScroll);
+
+    bool twoFingerScroll = this->propertiesList.contains(SYNAPTICS_PROP_SCROLL_TWOFINGER) &&
+        client->capability(P_CAP_TWO_FINGERS);
+    ui->ScrollVertTFEnableCB->setEnabled(twoFingerScroll);
+    ui->ScrollHorizTFEnableCB->setEnabled(twoFingerScroll);
+
+    ui->ScrollCoastingEnableCB->setEnabled(this->propertiesList.contains(SYNAPTICS_PROP_COASTING_SPEED));
+    ui->ScrollCircularEnableCB->setEnabled(this->propertiesList.contains(SYNAPTICS_PROP_CIRCULAR_SCROLLING));
+
+    bool tapping = this->propertiesList.contains(SYNAPTICS_PROP_TAP_TIME);
+    ui->TappingEnableCB->setEnabled(tapping);
+    ui->TapDelayMeasureCB->setEnabled(tapping);
+
+    bool tapActions = this->propertiesList.contains(SYNAPTICS_PROP_TAP_ACTION);
+    ui->TappingButtonLW->setEnabled(tapActions);
+    /* Do not offer events Touchpad does not claim to support */
+    ui->TappingEventLW->item(Synaptics::TwoFingers)->setHidden(!client->capability(P_CAP_TWO_FINGERS));
+    ui->TappingEventLW->item(Synaptics::ThreeFingers)->setHidden(!client->capability(P_CAP_THREE_FINGERS));
+    ui->TappingEventLW->setEnabled(tapActions);
+    ui->ButtonTappingL->setEnabled(tapActions);
+    ui->ButtonMeansL->setEnabled(tapActions);
+
+    // the slots of the check boxes enable what depends on them, but only
+    // if the device has it; whatever another device left enabled goes off
+    QWidget* dependent[] = {
+        ui->TouchpadOffWOMoveCB,
+        ui->ScrollVertHighL, ui->ScrollVertSpeedS, ui->ScrollVertLowL,
+        ui->ScrollHorizHighL, ui->ScrollHorizSpeedS, ui->ScrollHorizLowL,
+        ui->ScrollCoastingSlowL, ui->ScrollCoastingFastL, ui->ScrollCoastingSpeedS,
+        ui->ScrollCoastingCornerEnableCB,
+        ui->ScrollCircularSlowL, ui->ScrollCircularSpeedS, ui->ScrollCircularFastL,
+        ui->ScrollCircularUseL, ui->ScrollCircularCornersCBB,
+        ui->TappingMaxMoveL, ui->TappingMaxMoveValueS, ui->TappingMaxMoveValueL,
+        ui->TappingMaxMovePointsL,
+        ui->TappingTimeoutL, ui->TappingTimeoutValueS, ui->TappingTimeoutValueL,
+        ui->TappingTimeoutMilisecondsL,
+        ui->TappingDoubleTimeL, ui->TappingDoubleTimeValueS, ui->TappingDoubleTimeValueL,
+        ui->TappingDoubleTimeMilisecondsL,
+        ui->TappingClickTimeL, ui->TappingClickTimeValueS, ui->TappingClickTimeValueL,
+        ui->TappingClickTimeMillisecondsL
+    };
+    for (unsigned i = 0; i < sizeof(dependent) / sizeof(dependent[0]); i++)
+        dependent[i]->setEnabled(false);
+
+    bool wasRefreshing = refreshing;
+    refreshing = true;
+    touchpadEnabled(ui->TouchpadOnRB->isChecked());
+    scrollVerticalEnabled(ui->ScrollVertEnableCB->isChecked());
+    scrollHorizontalEnabled(ui->ScrollHorizEnableCB->isChecked());
+    scrollCoastingEnabled(ui->ScrollCoastingEnableCB->isChecked());
+    circularScrollEnabled(ui->ScrollCircularEnableCB->isChecked());
+    tappingEnabled(ui->TappingEnableCB->isChecked());
+    refreshing = wasRefreshing;
 }
 
 /*
@@ -193,70 +574,40 @@ void TouchpadConfig::load()
     if (setup_failed)
         return;
 
-    KConfigGroup config(KSharedConfig::openConfig("kcmtouchpadrc", KConfig::NoGlobals), "Touchpad");
+    revertPreview();
+    // positions collected so far may belong to another device
+    ui->CalibrateB->setChecked(false);
+
+    KSharedConfigPtr rc = KSharedConfig::openConfig("kcmtouchpadrc", KConfig::NoGlobals);
+    KConfigGroup general = deviceConfig(rc, QString());
+    KConfigGroup config = deviceConfig(rc, client->deviceName());
 
-    // loads every entry of configuration and sets corresponding widget
-    // when configuration doesn't exist collect actual value from driver
+    // the configuration comes first; the driver is asked only for what it
+    // lacks, at once with a single request per property, or from the
+    // service's snapshot. apply() sends the configured values the first
+    // time, as the driver's are not known.
+    param_values driver = unconfiguredDriverValues(client, config);
+    driverValues = driver;
 
-    if (this->propertiesList.contains(SYNAPTICS_PROP_OFF)) {
-        ui->TouchpadOnRB->setChecked(!config.readEntry("TouchpadOff", !(int)*(char*)Touchpad::get_parameter("TouchpadOff")));
-        ui->TouchpadOffWOMoveCB->setCheckState(config.readEntry("TouchpadOff", (int)*(char*)Touchpad::get_parameter("TouchpadOff")) == 2 ? Qt::Checked : Qt::Unchecked);
+    // every widget shows the configured setting, or the driver's value
+    for (const SettingBinding* binding = bindings; binding->parameter; binding++) {
+        if (isBound(*binding, propertiesList))
+            showSetting(*binding, config.readEntry(binding->parameter, driverSetting(*binding, driver)));
     }
 
-    ui->SmartModeEnableCB->setCheckState(config.readEntry("SmartModeEnabled", false) ? Qt::Checked : Qt::Unchecked);
-    ui->SmartModeDelayS->setValue(config.readEntry("SmartModeDelay", 1000));
+    ui->LivePreviewCB->setChecked(general.readEntry("LivePreview", false));
 
-    if (this->propertiesList.contains(SYNAPTICS_PROP_FINGER)) {
-        ui->SensitivityValueS->setValue(config.readEntry("FingerLow", *(int*)Touchpad::get_parameter("FingerLow") / 10));
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_SCROLL_EDGE)) {
-        ui->ScrollVertEnableCB->setCheckState(config.readEntry("VertEdgeScroll", (int)*(char*)Touchpad::get_parameter("VertEdgeScroll")) ? Qt::Checked : Qt::Unchecked);
-        ui->ScrollHorizEnableCB->setCheckState(config.readEntry("HorizEdgeScroll", (int)*(char*)Touchpad::get_parameter("HorizEdgeScroll")) ? Qt::Checked : Qt::Unchecked);
-        if (this->propertiesList.contains(SYNAPTICS_PROP_COASTING_SPEED)) {
-            ui->ScrollCoastingCornerEnableCB->setCheckState(config.readEntry("CornerCoasting", (int)*(char*)Touchpad::get_parameter("CornerCoasting")) ? Qt::Checked : Qt::Unchecked);
-        }
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_SCROLL_DISTANCE)) {
-        ui->ScrollVertSpeedS->setValue(config.readEntry("VertScrollDelta", *(int*)Touchpad::get_parameter("VertScrollDelta")));
-        ui->ScrollHorizSpeedS->setValue(config.readEntry("HorizScrollDelta", *(int*)Touchpad::get_parameter("HorizScrollDelta")));
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_SCROLL_TWOFINGER)) {
-        ui->ScrollVertTFEnableCB->setCheckState(config.readEntry("VertTwoFingerScroll", (int)*(char*)Touchpad::get_parameter("VertTwoFingerScroll")) ? Qt::Checked : Qt::Unchecked);
-        ui->ScrollHorizTFEnableCB->setCheckState(config.readEntry("HorizTwoFingerScroll", (int)*(char*)Touchpad::get_parameter("HorizTwoFingerScroll")) ? Qt::Checked : Qt::Unchecked);
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_COASTING_SPEED)) {
-        ui->ScrollCoastingEnableCB->setCheckState(config.readEntry("CoastingSpeed", *(double*)Touchpad::get_parameter("CoastingSpeed")) ? Qt::Checked : Qt::Unchecked);
-        ui->ScrollCoastingSpeedS->setValue(config.readEntry("CoastingSpeed", *(double*)Touchpad::get_parameter("CoastingSpeed")) * 100.0f);
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_CIRCULAR_SCROLLING)) {
-        ui->ScrollCircularEnableCB->setCheckState(config.readEntry("CircularScrolling", (int)*(char*)Touchpad::get_parameter("CircularScrolling")) ? Qt::Checked : Qt::Unchecked);
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_CIRCULAR_SCROLLING_DIST)) {
-        ui->ScrollCircularSpeedS->setValue(ScrollCircularScale*config.readEntry("CircScrollDelta", *(double*)Touchpad::get_parameter("CircScrollDelta")));
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_CIRCULAR_SCROLLING_TRIGGER)) {
-        ui->ScrollCircularCornersCBB->setCurrentIndex(config.readEntry("CircScrollTrigger", (int)*(char*)Touchpad::get_parameter("CircScrollTrigger")));
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_TAP_TIME)) {
-        ui->TappingEnableCB->setCheckState(config.readEntry("MaxTapTime", *(int*)Touchpad::get_parameter("MaxTapTime")) ? Qt::Checked : Qt::Unchecked);
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_TAP_MOVE)) {
-        ui->TappingMaxMoveValueS->setValue(config.readEntry("MaxTapMove", *(int*)Touchpad::get_parameter("MaxTapMove")));
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_TAP_DURATIONS)) {
-        ui->TappingTimeoutValueS->setValue(config.readEntry("SingleTapTimeout", *(int*)Touchpad::get_parameter("SingleTapTimeout")));
-        ui->TappingDoubleTimeValueS->setValue(config.readEntry("MaxDoubleTapTime", *(int*)Touchpad::get_parameter("MaxDoubleTapTime")));
-        ui->TappingClickTimeValueS->setValue(config.readEntry("ClickTime", *(int*)Touchpad::get_parameter("ClickTime")));
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_TAP_ACTION)) {
-        tappingButtonsMap[Synaptics::OneFinger] = config.readEntry("TapButton1", (int)*(char*)Touchpad::get_parameter("TapButton1"));
-        tappingButtonsMap[Synaptics::TwoFingers] = config.readEntry("TapButton2", (int)*(char*)Touchpad::get_parameter("TapButton2"));
-        tappingButtonsMap[Synaptics::ThreeFingers] = config.readEntry("TapButton3", (int)*(char*)Touchpad::get_parameter("TapButton3"));
-        tappingButtonsMap[Synaptics::RightTop] = config.readEntry("RTCornerButton", (int)*(char*)Touchpad::get_parameter("RTCornerButton"));
-        tappingButtonsMap[Synaptics::RightBottom] = config.readEntry("RBCornerButton", (int)*(char*)Touchpad::get_parameter("RBCornerButton"));
-        tappingButtonsMap[Synaptics::LeftTop] = config.readEntry("LTCornerButton", (int)*(char*)Touchpad::get_parameter("LTCornerButton"));
-        tappingButtonsMap[Synaptics::LeftBottom] = config.readEntry("LBCornerButton", (int)*(char*)Touchpad::get_parameter("LBCornerButton"));
-    }
+    appliedSmartMode = general.readEntry("SmartModeEnabled", false);
+    appliedSmartModeDelay = general.readEntry("SmartModeDelay", 1000);
+    ui->SmartModeEnableCB->setCheckState(appliedSmartMode ? Qt::Checked : Qt::Unchecked);
+    ui->SmartModeDelayS->setValue(appliedSmartModeDelay);
+
+    calibratedEdges = savedEdges(config, propertiesList);
+    showEdges();
+
+    // setting the widgets is no change to preview
+    previewTimer.stop();
+    pendingChanges = false;
 }
 
 /*
@@ -268,78 +619,39 @@ void TouchpadConfig::save()
     if (setup_failed)
         return;
 
+    previewTimer.stop();
     if(apply() == false)
         return;
-
-    KConfigGroup config(KSharedConfig::openConfig("kcmtouchpadrc", KConfig::NoGlobals), "Touchpad");
-
-    if (this->propertiesList.contains(SYNAPTICS_PROP_OFF)) {
-        if (ui->TouchpadOffRB->isChecked()) {
-            if (ui->TouchpadOffWOMoveCB->isChecked())
-                config.writeEntry("TouchpadOff", 2);
-            else
-                config.writeEntry("TouchpadOff", 1);
-        }
+    previewed = false;
+
+    KSharedConfigPtr rc = KSharedConfig::openConfig("kcmtouchpadrc", KConfig::NoGlobals);
+    KConfigGroup general = deviceConfig(rc, QString());
+    KConfigGroup config = deviceConfig(rc, client->deviceName(), true);
+
+    for (const SettingBinding* binding = bindings; binding->parameter; binding++) {
+        if (!isBound(*binding, propertiesList))
+            continue;
+        // whole numbers are written without decimals, as they always were
+        double setting = widgetSetting(*binding);
+        if (setting == (int)setting)
+            config.writeEntry(binding->parameter, (int)setting);
         else
-            config.writeEntry("TouchpadOff", 0);
-    }
-
-    config.writeEntry("SmartModeEnabled", ui->SmartModeEnableCB->isChecked());
-    config.writeEntry("SmartModeDelay", ui->SmartModeDelayS->value());
-
-    if (this->propertiesList.contains(SYNAPTICS_PROP_FINGER)) {
-        config.writeEntry("FingerLow", ui->SensitivityValueS->value());
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_SCROLL_EDGE)) {
-        config.writeEntry("VertEdgeScroll", (int)ui->ScrollVertEnableCB->isChecked());
-        config.writeEntry("HorizEdgeScroll", (int)ui->ScrollHorizEnableCB->isChecked());
-        if (this->propertiesList.contains(SYNAPTICS_PROP_COASTING_SPEED)) {
-            config.writeEntry("CornerCoasting", (int)ui->ScrollCoastingCornerEnableCB->isChecked());
-        }
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_SCROLL_DISTANCE)) {
-        config.writeEntry("VertScrollDelta", ui->ScrollVertSpeedS->value());
-        config.writeEntry("HorizScrollDelta", ui->ScrollHorizSpeedS->value());
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_SCROLL_TWOFINGER)) {
-        config.writeEntry("VertTwoFingerScroll", (int)ui->ScrollVertTFEnableCB->isChecked());
-        config.writeEntry("HorizTwoFingerScroll", (int)ui->ScrollHorizTFEnableCB->isChecked());
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_COASTING_SPEED)) {
-        config.writeEntry("CoastingSpeed", (int)ui->ScrollCoastingEnableCB->isChecked() ? (double)ui->ScrollCoastingSpeedS->value() / 100.0f : 0.0f);
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_CIRCULAR_SCROLLING)) {
-        config.writeEntry("CircularScrolling", (int)ui->ScrollCircularEnableCB->isChecked());
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_CIRCULAR_SCROLLING_DIST)) {
-        config.writeEntry("CircScrollDelta", (double)ui->ScrollCircularSpeedS->value() / ScrollCircularScale);
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_CIRCULAR_SCROLLING_TRIGGER)) {
-        config.writeEntry("CircScrollTrigger", ui->ScrollCircularCornersCBB->currentIndex());
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_TAP_TIME)) {
-        config.writeEntry("MaxTapTime", (int)ui->TappingEnableCB->isChecked() * 180);
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_TAP_MOVE)) {
-        config.writeEntry("MaxTapMove", ui->TappingMaxMoveValueS->value());
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_TAP_DURATIONS)) {
-        config.writeEntry("SingleTapTimeout", ui->TappingTimeoutValueS->value());
-        config.writeEntry("MaxDoubleTapTime", ui->TappingDoubleTimeValueS->value());
-        config.writeEntry("ClickTime", ui->TappingClickTimeValueS->value());
+            config.writeEntry(binding->parameter, setting);
     }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_TAP_ACTION)) {
-        config.writeEntry("TapButton1", this->tappingButtonsMap[Synaptics::OneFinger]);
-        config.writeEntry("TapButton2", this->tappingButtonsMap[Synaptics::TwoFingers]);
-        config.writeEntry("TapButton3", this->tappingButtonsMap[Synaptics::ThreeFingers]);
-        config.writeEntry("RTCornerButton", this->tappingButtonsMap[Synaptics::RightTop]);
-        config.writeEntry("RBCornerButton", this->tappingButtonsMap[Synaptics::RightBottom]);
-        config.writeEntry("LTCornerButton", this->tappingButtonsMap[Synaptics::LeftTop]);
-        config.writeEntry("LBCornerButton", this->tappingButtonsMap[Synaptics::LeftBottom]);
+    for (param_values::const_iterator it = calibratedEdges.begin(); it != calibratedEdges.end(); ++it) {
+        config.writeEntry(it->first, (int)it->second);
     }
 
+    general.writeEntry("SmartModeEnabled", ui->SmartModeEnableCB->isChecked());
+    general.writeEntry("SmartModeDelay", ui->SmartModeDelayS->value());
+    general.writeEntry("LivePreview", ui->LivePreviewCB->isChecked());
+
     // synchronize config entries with file
-    config.sync();
+    rc->sync();
+
+    // taken after the file was written, see snapshotCurrent()
+    client->saveSnapshot(snapshotPath());
+    pendingChanges = false;
 }
 
 /*
@@ -375,125 +687,249 @@ void TouchpadConfig::setSmartMode(bool enable, unsigned interval)
 	"org.kde.KSyndaemon",
 	QDBusConnection::sessionBus());
 
-    // FIXME currently subsecond resolution is not supported
-    interval /= 1000;
-    if (interval == 0)
-	interval = 1;
-
     if (enable) {
-	interface.call("setInterval", interval);
-	interface.call("startMonitoring");
+	interface.asyncCall("setInterval", interval);
+	interface.asyncCall("startMonitoring");
     } else {
-	interface.call("stopMonitoring");
+	interface.asyncCall("stopMonitoring");
     }
 }
 
 /*
- * This function applies sensitivity setting to driver.
- * It is a bit tricky because driver (hardware?) will refuse to apply
- * out of order values (i.e. you cannot set upper limit less than current
- * low limit and vice versa).
+ * This function applies changes to driver.
+ * It gets value from every widget and calls corresponding function
+ * which saves this value to SHM
 */
-void TouchpadConfig::applySensitivity(int val)
+bool TouchpadConfig::apply(bool preview)
 {
-    int oldLow = *(int*)Touchpad::get_parameter("FingerLow");
-    int oldHigh = *(int*)Touchpad::get_parameter("FingerHigh");
-    int newLow = val * 10 + 1;
-    int newHigh = val * 10 + 6;
+    param_values values;
 
-    if (newLow < oldHigh) {
-	Touchpad::set_parameter("FingerLow", newLow);
-	Touchpad::set_parameter("FingerHigh", newHigh);
-    } else {
-	Touchpad::set_parameter("FingerHigh", newHigh);
-	Touchpad::set_parameter("FingerLow", newLow);
+    for (const SettingBinding* binding = bindings; binding->parameter; binding++) {
+        if (isBound(*binding, propertiesList))
+            putSetting(values, *binding, widgetSetting(*binding));
+    }
+    // edges and area go out in the same batch, one change per property
+    values.insert(calibratedEdges.begin(), calibratedEdges.end());
+
+    // ksyndaemon restarts monitoring on every call, bother it only on change
+    if (!preview && (ui->SmartModeEnableCB->isChecked() != appliedSmartMode
+        || (appliedSmartMode && ui->SmartModeDelayS->value() != appliedSmartModeDelay))) {
+        appliedSmartMode = ui->SmartModeEnableCB->isChecked();
+        appliedSmartModeDelay = ui->SmartModeDelayS->value();
+        setSmartMode(appliedSmartMode, appliedSmartModeDelay);
     }
+
+    // only what differs from the driver is sent
+    client->setParameters(values, driverValues);
+
+    return true;
+}
+
+
+void TouchpadConfig::changed() {
+    if (refreshing)
+        return;
+
+    pendingChanges = true;
+    emit KCModule::changed(true);
+    // changes coming faster are merged into the pending preview
+    if (ui->LivePreviewCB->isChecked() && !previewTimer.isActive())
+        previewTimer.start();
 }
 
 /*
- * This function applies changes to driver.
- * It gets value from every widget and calls corresponding function
- * which saves this value to SHM
-*/
-bool TouchpadConfig::apply()
-{
-    if (this->propertiesList.contains(SYNAPTICS_PROP_OFF)) {
-        if(ui->TouchpadOffRB->isChecked())
-        {
-            if(ui->TouchpadOffWOMoveCB->isChecked())
-                Touchpad::set_parameter("TouchpadOff", 2);
-            else
-                Touchpad::set_parameter("TouchpadOff", 1);
-        }
-        else
-            Touchpad::set_parameter("TouchpadOff", 0);
+ * Sends the driver settings shown by the dialog, without saving them.
+ * The driver state from before the first preview is kept for reverting.
+ */
+void TouchpadConfig::previewChanges()
+{
+    if (!previewed) {
+        // driverValues lacks what load() took from the configuration
+        previewDevice = client->currentDevice();
+        previewBaseline = shownDriverValues(client);
+        previewed = true;
     }
 
-    setSmartMode(ui->SmartModeEnableCB->isChecked(), ui->SmartModeDelayS->value());
+    apply(true);
+}
 
-    if (this->propertiesList.contains(SYNAPTICS_PROP_FINGER)) {
-	applySensitivity(ui->SensitivityValueS->value());
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_SCROLL_EDGE)) {
-        Touchpad::set_parameter("VertEdgeScroll", ui->ScrollVertEnableCB->isChecked());
-        Touchpad::set_parameter("HorizEdgeScroll", ui->ScrollHorizEnableCB->isChecked());
-        if (this->propertiesList.contains(SYNAPTICS_PROP_COASTING_SPEED)) {
-            Touchpad::set_parameter("CornerCoasting", ui->ScrollCoastingCornerEnableCB->isChecked());
-        }
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_SCROLL_DISTANCE)) {
-        Touchpad::set_parameter("VertScrollDelta", ui->ScrollVertSpeedS->value());
-        Touchpad::set_parameter("HorizScrollDelta", ui->ScrollHorizSpeedS->value());
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_SCROLL_TWOFINGER)) {
-        Touchpad::set_parameter("VertTwoFingerScroll", ui->ScrollVertTFEnableCB->isChecked());
-        Touchpad::set_parameter("HorizTwoFingerScroll", ui->ScrollHorizTFEnableCB->isChecked());
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_COASTING_SPEED)) {
-        Touchpad::set_parameter("CoastingSpeed", ui->ScrollCoastingEnableCB->isChecked() ? ui->ScrollCoastingSpeedS->value() / 100.0f : 0.0f);
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_CIRCULAR_SCROLLING)) {
-        Touchpad::set_parameter("CircularScrolling", ui->ScrollCircularEnableCB->isChecked());
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_CIRCULAR_SCROLLING_DIST)) {
-        Touchpad::set_parameter("CircScrollDelta", (double)ui->ScrollCircularSpeedS->value() / ScrollCircularScale);
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_CIRCULAR_SCROLLING_TRIGGER)) {
-        Touchpad::set_parameter("CircScrollTrigger", ui->ScrollCircularCornersCBB->currentIndex());
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_TAP_TIME)) {
-        Touchpad::set_parameter("MaxTapTime", (int)ui->TappingEnableCB->isChecked() * 180);
-    }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_TAP_MOVE)) {
-        Touchpad::set_parameter("MaxTapMove", ui->TappingMaxMoveValueS->value());
+/*
+ * Puts back the driver settings changed by previewing since the last
+ * load or save. Works on the previewed device even if another one is
+ * shown meanwhile.
+ */
+void TouchpadConfig::revertPreview()
+{
+    previewTimer.stop();
+    if (!previewed)
+        return;
+    previewed = false;
+
+    int shown = client->currentDevice();
+    if (!client->selectDevice(previewDevice))
+        return;     // unplugged
+
+    param_values values;
+    for (param_values::const_iterator it = previewBaseline.begin(); it != previewBaseline.end(); ++it) {
+        // capabilities are read-only
+        if (it->first[0] != '_')
+            values[it->first] = it->second;
     }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_TAP_DURATIONS)) {
-        Touchpad::set_parameter("SingleTapTimeout", ui->TappingTimeoutValueS->value());
-        Touchpad::set_parameter("MaxDoubleTapTime", ui->TappingDoubleTimeValueS->value());
-        Touchpad::set_parameter("ClickTime", ui->TappingClickTimeValueS->value());
+    if (previewDevice == shown)
+        client->setParameters(values, driverValues);
+    else
+        client->setParameters(values);
+
+    client->selectDevice(shown);
+}
+
+void TouchpadConfig::livePreviewEnabled(bool toggle)
+{
+    if (!toggle)
+        revertPreview();
+    emit this->changed();
+}
+
+/*
+ * Called when other clients, e.g. syndaemon, changed properties of the shown
+ * device. Refreshes their widgets without marking the module as changed.
+ */
+void TouchpadConfig::touchpadPropertiesChanged(const QSet<QString>& properties)
+{
+    refreshing = true;
+    refreshWidgets(properties);
+    refreshing = false;
+}
+
+/*
+ * Configures devices plugged in while the dialog is open and shows another
+ * device if the shown one went away.
+ */
+void TouchpadConfig::touchpadDevicesChanged(const QList<int>& added, const QList<int>& removed)
+{
+    int shown = ui->DeviceSelectCBB->itemData(ui->DeviceSelectCBB->currentIndex()).toInt();
+    int current = client->currentDevice();
+
+    bool snapshot = snapshotCurrent();
+    foreach (int id, added) {
+        client->selectDevice(id);
+        if (!snapshot || client->restoreSnapshot(snapshotPath()) < 0)
+            applySavedConfig(*client);
+    }
+    client->selectDevice(current);
+
+    updateDeviceList();
+    if (removed.contains(shown)) {
+        propertiesList = client->deviceProperties();
+        load();
+        enableProperties();
+        emit KCModule::changed(false);
+        if (ui->TapDelayMeasureCB->isChecked())
+            tapDelayMeasured(true);
+        if (ui->HeatmapRecordCB->isChecked())
+            heatmapRecorded(true);
     }
-    if (this->propertiesList.contains(SYNAPTICS_PROP_TAP_ACTION)) {
-        Touchpad::set_parameter("TapButton1", this->tappingButtonsMap[Synaptics::OneFinger]);
-        Touchpad::set_parameter("TapButton2", this->tappingButtonsMap[Synaptics::TwoFingers]);
-        Touchpad::set_parameter("TapButton3", this->tappingButtonsMap[Synaptics::ThreeFingers]);
-        Touchpad::set_parameter("RTCornerButton", this->tappingButtonsMap[Synaptics::RightTop]);
-        Touchpad::set_parameter("RBCornerButton", this->tappingButtonsMap[Synaptics::RightBottom]);
-        Touchpad::set_parameter("LTCornerButton", this->tappingButtonsMap[Synaptics::LeftTop]);
-        Touchpad::set_parameter("LBCornerButton", this->tappingButtonsMap[Synaptics::LeftBottom]);
+}
+
+/*
+ * Shows current driver values in the widgets of given properties.
+ * Values come from the property mirror or the cache of the service's
+ * values, so this costs no round trip.
+ */
+void TouchpadConfig::refreshWidgets(const QSet<QString>& changedProperties)
+{
+    param_values driver = shownDriverValues(client);
+
+    // previewed writes are notified too; widgets still showing the value
+    // the driver was given must not jump back to an older one
+    QSet<QString> properties;
+    for (param_values::const_iterator it = driver.begin(); it != driver.end(); ++it) {
+        param_values::const_iterator known = driverValues.find(it->first);
+        if (known == driverValues.end() || (float)known->second != (float)it->second)
+            properties.insert(propertyName(it->first));
     }
+    properties &= changedProperties;
+    driverValues = driver;
 
-    return true;
+    for (const SettingBinding* binding = bindings; binding->parameter; binding++) {
+        if (properties.contains(propertyName(binding->parameter)) && driver.count(binding->parameter))
+            showSetting(*binding, driverSetting(*binding, driver));
+    }
 }
 
+/*
+ * The setting binding's widget shows.
+ */
+double TouchpadConfig::widgetSetting(const SettingBinding& binding) const
+{
+    switch (binding.kind) {
+    case CheckBinding:
+        return findChild<QCheckBox*>(binding.widget)->isChecked() ? binding.scale : 0;
+    case SliderBinding:
+        return findChild<QSlider*>(binding.widget)->value() / binding.scale;
+    case ComboBinding:
+        return findChild<QComboBox*>(binding.widget)->currentIndex();
+    case OffBinding:
+        if (!findChild<QRadioButton*>(binding.widget)->isChecked())
+            return 0;
+        return findChild<QCheckBox*>(binding.partner)->isChecked() ? 2 : 1;
+    case SensitivityBinding:
+        return findChild<QSlider*>(binding.widget)->value();
+    case CoastingBinding:
+        if (!findChild<QCheckBox*>(binding.widget)->isChecked())
+            return 0;
+        return findChild<QSlider*>(binding.partner)->value() / binding.scale;
+    case ButtonBinding:
+        return tappingButtonsMap.value(binding.tap);
+    }
+    return 0;
+}
 
-void TouchpadConfig::changed() {
-    emit KCModule::changed(true);
+/*
+ * Shows setting in binding's widget.
+ */
+void TouchpadConfig::showSetting(const SettingBinding& binding, double setting)
+{
+    switch (binding.kind) {
+    case CheckBinding:
+        findChild<QCheckBox*>(binding.widget)->setChecked(setting != 0);
+        break;
+    case SliderBinding:
+        findChild<QSlider*>(binding.widget)->setValue(qRound(setting * binding.scale));
+        break;
+    case ComboBinding:
+        findChild<QComboBox*>(binding.widget)->setCurrentIndex((int)setting);
+        break;
+    case OffBinding:
+        // the buttons are exclusive, "on" can only be unchecked by "off"
+        if (setting)
+            findChild<QRadioButton*>(binding.widget)->setChecked(true);
+        else
+            ui->TouchpadOnRB->setChecked(true);
+        findChild<QCheckBox*>(binding.partner)->setChecked((int)setting == 2);
+        break;
+    case SensitivityBinding:
+        findChild<QSlider*>(binding.widget)->setValue((int)setting);
+        break;
+    case CoastingBinding:
+        findChild<QCheckBox*>(binding.widget)->setChecked(setting != 0);
+        // the speed stays as it was while coasting is off
+        if (setting)
+            findChild<QSlider*>(binding.partner)->setValue(qRound(setting * binding.scale));
+        break;
+    case ButtonBinding:
+        tappingButtonsMap[binding.tap] = (int)setting;
+        // the button list shows the selected event's button
+        if (ui->TappingEventLW->currentRow() == binding.tap)
+            tappingEventListSelected(ui->TappingEventLW->currentRow());
+        break;
+    }
 }
 
 void TouchpadConfig::touchpadEnabled(bool toggle) {
     emit this->changed();
 
-    if(toggle)
+    if(toggle || !this->propertiesList.contains(SYNAPTICS_PROP_OFF))
         ui->TouchpadOffWOMoveCB->setEnabled(false);
     else
         ui->TouchpadOffWOMoveCB->setEnabled(true);
@@ -650,6 +1086,158 @@ void TouchpadConfig::tappingClickTimeChanged(int value) {
     emit this->changed();
 }
 
+/*
+ * Measures the delays of the clicks of taps under the settings the driver
+ * has, so with live preview the effect of each change shows at once.
+ */
+void TouchpadConfig::tapDelayMeasured(bool toggle) {
+    tapDelayTimer.stop();
+    client->stopTapAnalysis();
+    ui->TapDelayValueL->setEnabled(toggle);
+    if (!toggle)
+        return;
+
+    // all of them take the events of the touchpad
+    ui->CalibrateB->setChecked(false);
+    ui->HeatmapRecordCB->setChecked(false);
+
+    if (!client->startTapAnalysis()) {
+        ui->TapDelayValueL->setText(i18n("Touchpad events cannot be watched"));
+        return;
+    }
+    showTapDelay();
+    tapDelayTimer.start();
+}
+
+void TouchpadConfig::showTapDelay() {
+    QVariantMap latency = client->tapLatency();
+    int taps = latency.value("taps").toInt();
+
+    if (taps == 0) {
+        ui->TapDelayValueL->setText(i18n("Tap the touchpad a few times"));
+        return;
+    }
+
+    int p50 = latency.value("p50").toInt();
+    int p95 = latency.value("p95").toInt();
+    int p99 = latency.value("p99").toInt();
+    // without pressure the moment the finger leaves is a guess
+    if (latency.value("estimated").toBool())
+        ui->TapDelayValueL->setText(i18np("About %2 ms, 95%: %3 ms, 99%: %4 ms (1 tap)",
+                                          "About %2 ms, 95%: %3 ms, 99%: %4 ms (%1 taps)",
+                                          taps, p50, p95, p99));
+    else
+        ui->TapDelayValueL->setText(i18np("%2 ms, 95%: %3 ms, 99%: %4 ms (1 tap)",
+                                          "%2 ms, 95%: %3 ms, 99%: %4 ms (%1 taps)",
+                                          taps, p50, p95, p99));
+}
+
+/*
+ * Collects the positions the touchpad reports for CalibrationTime ms while
+ * the user sweeps a finger along its edges; calibrationProgress() then
+ * takes the edges proposed from them.
+ */
+void TouchpadConfig::calibrationToggled(bool toggle) {
+    calibrationTimer.stop();
+    client->stopCalibration();
+    if (!toggle) {
+        showEdges();
+        return;
+    }
+
+    // all of them take the events of the touchpad
+    ui->TapDelayMeasureCB->setChecked(false);
+    ui->HeatmapRecordCB->setChecked(false);
+
+    if (!client->startCalibration()) {
+        ui->CalibrateB->setChecked(false);
+        ui->EdgesValueL->setText(i18n("Touchpad positions cannot be watched"));
+        return;
+    }
+    calibrationStarted.start();
+    calibrationProgress();
+    calibrationTimer.start();
+}
+
+void TouchpadConfig::calibrationProgress() {
+    param_values proposal;
+    unsigned long samples = client->calibration(proposal);
+    int elapsed = calibrationStarted.elapsed();
+
+    if (elapsed < CalibrationTime) {
+        int left = (CalibrationTime - elapsed + 999) / 1000;
+        ui->EdgesValueL->setText(i18np("Sweep a finger along all edges of the touchpad, 1 second left (%2 positions)",
+                                       "Sweep a finger along all edges of the touchpad, %1 seconds left (%2 positions)",
+                                       left, (qulonglong)samples));
+        return;
+    }
+
+    // shows the edges in use until the new ones are applied
+    ui->CalibrateB->setChecked(false);
+    if (proposal.empty() && samples < CALIBRATE_MIN_SAMPLES) {
+        ui->EdgesValueL->setText(i18n("Too few positions, try again moving the finger more"));
+        return;
+    }
+    if (proposal.empty()) {
+        ui->EdgesValueL->setText(i18n("The touchpad reports positions outside its range, "
+                                      "its edges cannot be calibrated"));
+        return;
+    }
+
+    calibratedEdges.clear();
+    for (param_values::const_iterator it = proposal.begin(); it != proposal.end(); ++it) {
+        if (this->propertiesList.contains(propertyName(it->first)))
+            calibratedEdges[it->first] = it->second;
+    }
+    showEdges();
+    emit this->changed();
+}
+
+void TouchpadConfig::showEdges() {
+    int edges[4];
+    for (int i = 0; i < 4; i++) {
+        param_values::const_iterator it = calibratedEdges.find(edgeParameters[i]);
+        if (it == calibratedEdges.end()) {
+            ui->EdgesValueL->setText(i18n("Not calibrated, the driver's edges are used"));
+            return;
+        }
+        edges[i] = (int)it->second;
+    }
+
+    ui->EdgesValueL->setText(i18n("Left %1, right %2, top %3, bottom %4",
+                                  edges[0], edges[1], edges[2], edges[3]));
+}
+
+/*
+ * Shows where the finger touches the touchpad. Only the cells which
+ * changed since the last frame come from the client and get repainted.
+ */
+void TouchpadConfig::heatmapRecorded(bool toggle) {
+    heatmapTimer.stop();
+    client->stopHeatmap();
+    ui->HeatmapW->clear();
+    ui->HeatmapW->setEnabled(toggle);
+    if (!toggle)
+        return;
+
+    // all of them take the events of the touchpad
+    ui->TapDelayMeasureCB->setChecked(false);
+    ui->CalibrateB->setChecked(false);
+
+    if (!client->startHeatmap()) {
+        ui->HeatmapRecordCB->setChecked(false);
+        ui->HeatmapRecordCB->setToolTip(i18n("Touchpad events cannot be watched"));
+        return;
+    }
+    heatmapTimer.start();
+}
+
+void TouchpadConfig::showHeatmap() {
+    QMap<int, unsigned long> cells;
+    client->heatmapChanges(cells);
+    ui->HeatmapW->setCells(cells);
+}
+
 void TouchpadConfig::tappingEventListSelected(int current)
 {
     ui->TappingButtonLW->setCurrentRow(tappingButtonsMap[current]);
@@ -662,84 +1250,113 @@ void TouchpadConfig::tappingButtonListSelected(int current)
     tappingButtonsMap[ui->TappingEventLW->currentRow()] = current;
 }
 
+/*
+ * Whether kcminit runs as part of KDE startup, started by startkde as
+ * kcminit_startup. Only then it goes on to run an event loop; "kcminit
+ * touchpad" run later returns right after the modules did their work.
+ */
+static bool inStartupPhase()
+{
+    QCoreApplication* application = QCoreApplication::instance();
+    return application &&
+        QFileInfo(application->arguments().value(0)).fileName() == "kcminit_startup";
+}
+
 /*
  * Function called at KDE startup.
- * Loads saved configuration and applies it to driver.
+ * Loads saved configuration and applies it to every device. During the
+ * startup phase, unless "DeferredInit" is turned off, only the settings
+ * the user notices right away are applied here; TouchpadInitializer does
+ * the rest later.
  */
 void TouchpadConfig::init_touchpad()
 {
-    if (Touchpad::init_xinput_extension() < 0) {
+    QTime timer;
+    timer.start();
+
+    // ksyndaemon is already running when kcminit is run again later
+    TouchpadClient* client = new TouchpadClient();
+    if (client->open() < 0) {
+        delete client;
         return;
     }
 
-    KConfigGroup config(KSharedConfig::openConfig( "kcmtouchpadrc" ), "Touchpad");
+    KConfigGroup general = deviceConfig(KSharedConfig::openConfig( "kcmtouchpadrc" ), QString());
+    // without an event loop nothing deferred would ever run
+    bool deferred = general.readEntry("DeferredInit", true) && inStartupPhase();
 
-    QList<const char*> propertiesList;
-    const prop_list* properties_list = Touchpad::get_properties_list();
-    for (prop_list::const_iterator it = properties_list->begin(); it != properties_list->end(); it++) {
-        propertiesList.append(*it);
+    // a snapshot puts everything back at once, without reading the config
+    bool snapshot = snapshotCurrent();
+    QList<int> restored;
+    foreach (int id, client->devices()) {
+        client->selectDevice(id);
+        if (snapshot && client->restoreSnapshot(snapshotPath()) >= 0) {
+            restored.append(id);
+            continue;
+        }
+        applySavedConfig(*client, deferred ? EssentialSettings : AllSettings);
     }
 
-    if (propertiesList.contains(SYNAPTICS_PROP_OFF)) {
-        Touchpad::set_parameter("TouchpadOff", config.readEntry("TouchpadOff", -1));
+    if (deferred) {
+        new TouchpadInitializer(client, timer.elapsed(), restored);
+        return;
     }
 
-    setSmartMode(config.readEntry("SmartModeEnabled", false),
-                           config.readEntry("SmartModeDelay", 1000));
+    setSmartMode(general.readEntry("SmartModeEnabled", false),
+                           general.readEntry("SmartModeDelay", 1000));
+    delete client;
+}
 
-    if (propertiesList.contains(SYNAPTICS_PROP_FINGER)) {
-        int value;
-        if ((value = config.readEntry("FingerLow", -1)) != -1) {
-	    applySensitivity(value);
-        }
-    }
-    if (propertiesList.contains(SYNAPTICS_PROP_SCROLL_EDGE)) {
-        Touchpad::set_parameter("VertEdgeScroll", config.readEntry("VertEdgeScroll", -1));
-        Touchpad::set_parameter("HorizEdgeScroll", config.readEntry("HorizEdgeScroll", -1));
-    }
-    if (propertiesList.contains(SYNAPTICS_PROP_SCROLL_DISTANCE)) {
-        Touchpad::set_parameter("VertScrollDelta", config.readEntry("VertScrollDelta", -1));
-        Touchpad::set_parameter("HorizScrollDelta", config.readEntry("HorizScrollDelta", -1));
-        if (propertiesList.contains(SYNAPTICS_PROP_COASTING_SPEED)) {
-            Touchpad::set_parameter("CornerCoasting", config.readEntry("CornerCoasting", -1));
-        }
-    }
-    if (propertiesList.contains(SYNAPTICS_PROP_SCROLL_TWOFINGER)) {
-        Touchpad::set_parameter("VertTwoFingerScroll", config.readEntry("VertTwoFingerScroll", -1));
-        Touchpad::set_parameter("HorizTwoFingerScroll", config.readEntry("HorizTwoFingerScroll", -1));
-    }
-    if (propertiesList.contains(SYNAPTICS_PROP_COASTING_SPEED)) {
-        Touchpad::set_parameter("CoastingSpeed", config.readEntry("CoastingSpeed", -1.0));
-    }
-    if (propertiesList.contains(SYNAPTICS_PROP_CIRCULAR_SCROLLING)) {
-        Touchpad::set_parameter("CircularScrolling", config.readEntry("CircularScrolling", -1));
-    }
-    if (propertiesList.contains(SYNAPTICS_PROP_CIRCULAR_SCROLLING_DIST)) {
-        Touchpad::set_parameter("CircScrollDelta", config.readEntry("CircScrollDelta", -1));
-    }
-    if (propertiesList.contains(SYNAPTICS_PROP_CIRCULAR_SCROLLING_TRIGGER)) {
-        Touchpad::set_parameter("CircScrollTrigger", (Synaptics::ScrollTrigger)config.readEntry("CircScrollTrigger", -1));
-    }
-    if (propertiesList.contains(SYNAPTICS_PROP_TAP_MOVE)) {
-        Touchpad::set_parameter("MaxTapMove", config.readEntry("MaxTapMove", -1 ));
+TouchpadInitializer::TouchpadInitializer(TouchpadClient* client, int startupTime, const QList<int>& restored)
+    : QObject(QCoreApplication::instance()),
+    client(client),
+    startupTime(startupTime),
+    restored(restored)
+{
+    client->setParent(this);
+    QTimer::singleShot(0, this, SLOT(run()));
+}
+
+void TouchpadInitializer::run()
+{
+    QTime timer;
+    timer.start();
+
+    foreach (int id, client->devices()) {
+        if (!restored.contains(id) && client->selectDevice(id))
+            TouchpadConfig::applySavedConfig(*client, TouchpadConfig::OtherSettings);
     }
-    if (propertiesList.contains(SYNAPTICS_PROP_TAP_DURATIONS)) {
-        Touchpad::set_parameter("MaxTapTime", config.readEntry("MaxTapTime", -1));
-        Touchpad::set_parameter("SingleTapTimeout", config.readEntry("SingleTapTimeout", -1));
-        Touchpad::set_parameter("MaxDoubleTapTime", config.readEntry("MaxDoubleTapTime", -1));
-        Touchpad::set_parameter("ClickTime", config.readEntry("ClickTime", -1));
+
+    KConfigGroup general = deviceConfig(KSharedConfig::openConfig( "kcmtouchpadrc" ), QString());
+    TouchpadConfig::setSmartMode(general.readEntry("SmartModeEnabled", false),
+                                 general.readEntry("SmartModeDelay", 1000));
+    client->close();
+
+    kDebug() << "startup path:" << startupTime << "ms, deferred:" << timer.elapsed() << "ms";
+    deleteLater();
+}
+
+/*
+ * Loads saved configuration of the current device and applies groups of it
+ * to driver.
+ */
+void TouchpadConfig::applySavedConfig(TouchpadClient& client, int groups)
+{
+    KConfigGroup config = deviceConfig(KSharedConfig::openConfig( "kcmtouchpadrc" ), client.deviceName());
+
+    QSet<QString> propertiesList = client.deviceProperties();
+    param_values values;
+
+    for (const SettingBinding* binding = bindings; binding->parameter; binding++) {
+        if ((binding->group & groups) && isBound(*binding, propertiesList) && config.hasKey(binding->parameter))
+            putSetting(values, *binding, config.readEntry(binding->parameter, 0.0));
     }
-    if (propertiesList.contains(SYNAPTICS_PROP_TAP_ACTION)) {
-        Touchpad::set_parameter("TapButton1", config.readEntry("TapButton1", -1));
-        Touchpad::set_parameter("TapButton2", config.readEntry("TapButton2", -1));
-        Touchpad::set_parameter("TapButton3", config.readEntry("TapButton3", -1));
-        Touchpad::set_parameter("RTCornerButton", config.readEntry("RTCornerButton", -1));
-        Touchpad::set_parameter("RBCornerButton", config.readEntry("RBCornerButton", -1));
-        Touchpad::set_parameter("LTCornerButton", config.readEntry("LTCornerButton", -1));
-        Touchpad::set_parameter("LBCornerButton", config.readEntry("LBCornerButton", -1));
+    if (groups & OtherSettings) {
+        param_values edges = savedEdges(config, propertiesList);
+        values.insert(edges.begin(), edges.end());
     }
 
-    Touchpad::free_xinput_extension();
+    client.setParameters(values);
 }
 
 extern "C"
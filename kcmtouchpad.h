@@ -26,8 +26,11 @@
 #ifndef _KCMTOUCHPAD_H
 #define _KCMTOUCHPAD_H
 
+#include <QList>
 #include <QSet>
 #include <QString>
+#include <QTime>
+#include <QTimer>
 #include <QtDBus/QtDBus>
 
 #include <KApplication>
@@ -36,6 +39,8 @@
 #include "touchpad.h"
 
 class Ui_TouchpadConfigWidget;
+class TouchpadClient;
+struct SettingBinding;
 
 class TouchpadConfig : public KCModule
 {
@@ -53,23 +58,74 @@ public:
 
     static void init_touchpad();
 
-private:
-    bool apply();
-    static void applySensitivity(int val);
+    /* parts of the saved configuration, applied separately at startup */
+    enum SettingsGroup {
+        EssentialSettings = 1,  // touchpad on/off and tapping
+        OtherSettings = 2,
+        AllSettings = EssentialSettings | OtherSettings
+    };
+    /* to the current device of client */
+    static void applySavedConfig(TouchpadClient& client, int groups = AllSettings);
     static void setSmartMode(bool enable, unsigned interval);
+
+private:
+    /* preview: only the driver settings, keeping smart mode as it is */
+    bool apply(bool preview = false);
+    void revertPreview();
     void enableProperties();
+    void updateDeviceList();
+    void refreshWidgets(const QSet<QString>& properties);
+    /* see the bindings table in kcmtouchpad.cpp */
+    double widgetSetting(const SettingBinding& binding) const;
+    void showSetting(const SettingBinding& binding, double setting);
+    void showEdges();
 
     Ui_TouchpadConfigWidget* ui;
+    TouchpadClient* client;
 
     /* map events to button: (event) -> (button) */
     QMap<int, int> tappingButtonsMap;
 
-    QSet<const char*> propertiesList;
+    /* synaptics properties of the shown device */
+    QSet<QString> propertiesList;
+
+    /* what apply() compares against: values the driver holds and the
+     * smart mode settings last sent to ksyndaemon */
+    param_values driverValues;
+    bool appliedSmartMode;
+    int appliedSmartModeDelay;
+
+    /* live preview: pending write, and the driver state to revert to */
+    QTimer previewTimer;
+    bool previewed;
+    int previewDevice;
+    param_values previewBaseline;
+
+    /* tap delay measurement, see tapDelayMeasured() */
+    QTimer tapDelayTimer;
+
+    /* edge calibration, see calibrationToggled(); calibratedEdges holds
+     * the edge and area parameters to apply, empty if not calibrated */
+    QTimer calibrationTimer;
+    QTime calibrationStarted;
+    param_values calibratedEdges;
+
+    /* touch density heatmap, see heatmapRecorded() */
+    QTimer heatmapTimer;
 
     bool setup_failed;
+    /* widgets are being updated from the driver, not by the user */
+    bool refreshing;
+    /* the user changed settings since the last load or save */
+    bool pendingChanges;
 
 private slots:
     void changed();
+    void previewChanges();
+    void livePreviewEnabled(bool toggle);
+    void touchpadPropertiesChanged(const QSet<QString>& properties);
+    void touchpadDevicesChanged(const QList<int>& added, const QList<int>& removed);
+    void deviceSelected(int index);
 
     void touchpadEnabled(bool toggle);
     void touchpadAllowedMoving(bool toggle);
@@ -78,6 +134,10 @@ private slots:
     void smartModeDelayChanged(int value);
 
     void sensitivityValueChanged(int value);
+    void calibrationToggled(bool toggle);
+    void calibrationProgress();
+    void heatmapRecorded(bool toggle);
+    void showHeatmap();
 
     void scrollVerticalEnabled(bool toggle);
     void scrollVerticalSpeedChanged(int value);
@@ -100,10 +160,35 @@ private slots:
     void tappingTimeoutChanged(int value);
     void tappingDoubleTimeChanged(int value);
     void tappingClickTimeChanged(int value);
+    void tapDelayMeasured(bool toggle);
+    void showTapDelay();
 
     void tappingEventListSelected(int current);
     void tappingButtonListSelected(int current);
 };
 
+/*
+ * Applies what init_touchpad() left out at KDE startup, once kcminit gets
+ * back to its event loop, then lets go of the touchpads.
+ */
+class TouchpadInitializer : public QObject
+{
+  Q_OBJECT
+
+public:
+    /* takes over client; startupTime: milliseconds init_touchpad() spent
+     * on the startup path; restored: devices put back from the snapshot,
+     * which need nothing more */
+    TouchpadInitializer(TouchpadClient* client, int startupTime, const QList<int>& restored);
+
+private slots:
+    void run();
+
+private:
+    TouchpadClient* client;
+    int startupTime;
+    QList<int> restored;
+};
+
 #endif
 
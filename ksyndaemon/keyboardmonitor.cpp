@@ -0,0 +1,153 @@
+/*
+   Copyright (C) 2009 by Andrey Borzenkov <arvidjaar at mail.ru>
+
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+ */
+
+#include <kdebug.h>
+
+#include "keyboardmonitor.h"
+#include "touchpadservice.h"
+#include "touchpad.h"
+
+KeyboardMonitor::KeyboardMonitor(TouchpadService *service, QObject *parent)
+	: QObject(parent),
+	m_service(service),
+	m_available(false),
+	m_active(false),
+	m_keyPresses(0),
+	m_timer()
+{
+	m_timer.setSingleShot(true);
+	connect(&m_timer, SIGNAL(timeout()), this, SLOT(enableTouchpads()));
+
+	if (!service->isAvailable() || !Touchpad::select_key_events(false)) {
+		kDebug() << "No XInput 2 touchpad access, falling back to syndaemon";
+		return;
+	}
+
+	m_available = true;
+	service->setKeyboardMonitor(this);
+}
+
+KeyboardMonitor::~KeyboardMonitor(void)
+{
+	stop();
+}
+
+bool
+KeyboardMonitor::isAvailable(void) const
+{
+	return m_available;
+}
+
+bool
+KeyboardMonitor::isActive(void) const
+{
+	return m_active;
+}
+
+void
+KeyboardMonitor::setInterval(unsigned msec)
+{
+	m_timer.setInterval(msec);
+}
+
+void
+KeyboardMonitor::start(void)
+{
+	if (!m_available || m_active)
+		return;
+
+	m_active = Touchpad::select_key_events(true);
+	m_keyPresses = Touchpad::key_press_count();
+	m_service->checkQueuedEvents();
+}
+
+void
+KeyboardMonitor::stop(void)
+{
+	if (!m_active)
+		return;
+
+	Touchpad::select_key_events(false);
+	m_active = false;
+	m_timer.stop();
+	enableTouchpads();
+}
+
+void
+KeyboardMonitor::eventsProcessed(void)
+{
+	if (!m_active || Touchpad::key_press_count() == m_keyPresses)
+		return;
+
+	m_keyPresses = Touchpad::key_press_count();
+	disableTouchpads();
+	m_timer.start();
+}
+
+int
+KeyboardMonitor::pendingTouchpadOff(int device) const
+{
+	return m_restore.value(device, -1);
+}
+
+/*
+ * Switches off every touchpad which is currently on, remembering
+ * the previous state. Reads come from the property mirror.
+ */
+void
+KeyboardMonitor::disableTouchpads(void)
+{
+	if (!m_restore.isEmpty())
+		return;
+
+	const device_list &devices = Touchpad::get_devices();
+	int previous = Touchpad::get_current_device();
+
+	for (device_list::const_iterator it = devices.begin(); it != devices.end(); it++) {
+		Touchpad::select_device(*it);
+
+		if (Touchpad::get_int(P_TOUCHPAD_OFF) != 0)
+			continue;	/* switched off by the user, leave it alone */
+
+		m_restore[*it] = 0;
+		Touchpad::set_parameter(P_TOUCHPAD_OFF, 1);
+	}
+
+	Touchpad::select_device(previous);
+}
+
+void
+KeyboardMonitor::enableTouchpads(void)
+{
+	int previous = Touchpad::get_current_device();
+
+	for (QMap<int, int>::const_iterator it = m_restore.constBegin(); it != m_restore.constEnd(); ++it) {
+		/* devices unplugged meanwhile are skipped */
+		if (Touchpad::select_device(it.key()))
+			Touchpad::set_parameter(P_TOUCHPAD_OFF, it.value());
+	}
+	m_restore.clear();
+
+	Touchpad::select_device(previous);
+	/* called by the timer too, outside the service */
+	m_service->checkQueuedEvents();
+}
+
+#include "keyboardmonitor.moc"
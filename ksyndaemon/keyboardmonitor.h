@@ -0,0 +1,77 @@
+/*
+   Copyright (C) 2009 by Andrey Borzenkov <arvidjaar at mail.ru>
+
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+ */
+
+#ifndef KEYBOARDMONITOR_H
+#define KEYBOARDMONITOR_H
+
+#include <QObject>
+#include <QMap>
+#include <QTimer>
+
+class TouchpadService;
+
+/*
+ * Disables touchpads while the keyboard is in use, like syndaemon -R,
+ * but in process: key presses come as XI2 raw events on the connection
+ * of the touchpad service and "Synaptics Off" is changed directly. Nothing
+ * runs while no key is pressed; a single timer re-enables the touchpads.
+ */
+class KeyboardMonitor : public QObject
+{
+	Q_OBJECT
+
+	public:
+		KeyboardMonitor(TouchpadService *service, QObject *parent = 0);
+		~KeyboardMonitor();
+
+		/* false when there is no touchpad or no XInput 2 */
+		bool isAvailable(void) const;
+		bool isActive(void) const;
+
+		/* milliseconds the touchpad stays off after the last key press */
+		void setInterval(unsigned msec);
+		void start(void);
+		void stop(void);
+
+		/* called by the service after it has read the pending events */
+		void eventsProcessed(void);
+
+		/*
+		 * "Synaptics Off" value the device gets back once typing
+		 * stops, -1 unless it is switched off for typing
+		 */
+		int pendingTouchpadOff(int device) const;
+
+	private Q_SLOTS:
+		void enableTouchpads(void);
+
+	private:
+		void disableTouchpads(void);
+
+		TouchpadService *m_service;
+		bool m_available;
+		bool m_active;
+		unsigned long m_keyPresses;
+		QTimer m_timer;
+		/* device id -> "Synaptics Off" value to restore */
+		QMap<int, int> m_restore;
+};
+
+#endif
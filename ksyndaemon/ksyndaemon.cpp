@@ -28,22 +28,55 @@
 
 #include "ksyndaemon.h"
 #include "ksyndaemonadaptor.h"
+#include "keyboardmonitor.h"
+#include "touchpadservice.h"
+#include "touchpadserviceadaptor.h"
+#include "touchpadwatcher.h"
 
 KSyndaemon::KSyndaemon(void)
 	: KUniqueApplication(false),
-	m_interval(1),
-	m_cmd("exec syndaemon -R -i "),
-	daemon()
+	m_interval(1000),
+	daemon(),
+	m_wanted(false),
+	m_stopping(false),
+	m_service(0),
+	m_monitor(0),
+	m_watcher(0)
 {
+	m_service = new TouchpadService(this);
+	m_monitor = new KeyboardMonitor(m_service, this);
+	m_monitor->setInterval(m_interval);
+	m_watcher = new TouchpadWatcher(m_service, m_monitor, this);
+
+	daemon.setStandardOutputFile("/dev/null");
+	connect(&daemon, SIGNAL(finished(int, QProcess::ExitStatus)),
+		this, SLOT(daemonFinished(int, QProcess::ExitStatus)));
+	connect(&daemon, SIGNAL(error(QProcess::ProcessError)),
+		this, SLOT(daemonFailed(QProcess::ProcessError)));
+
+	/* syndaemon gets this long to exit after SIGTERM */
+	m_killTimer.setSingleShot(true);
+	m_killTimer.setInterval(3000);
+	connect(&m_killTimer, SIGNAL(timeout()), this, SLOT(killDaemon()));
+
 	new KSyndaemonAdaptor(this);
 	QDBusConnection dbus = QDBusConnection::sessionBus();
 	dbus.registerObject("/Syndaemon", this);
+	new TouchpadAdaptor(m_service);
+	dbus.registerObject("/Touchpad", m_service);
 	dbus.registerService("org.kde.KSyndaemon");
 }
 
 KSyndaemon::~KSyndaemon(void)
 {
-	stopMonitoring();
+	m_monitor->stop();
+
+	/* quitting, the only place worth waiting for syndaemon */
+	if (daemon.state() != QProcess::NotRunning) {
+		daemon.terminate();
+		if (!daemon.waitForFinished(1000))
+			daemon.kill();
+	}
 }
 
 void
@@ -52,29 +85,97 @@ KSyndaemon::setInterval(unsigned i)
 	unsigned old = m_interval;
 
 	m_interval = i;
-	if (old != i && daemon.state() == QProcess::Running) {
-		stopMonitoring();
-		startMonitoring();
+	if (m_monitor->isAvailable()) {
+		/* takes effect with the next key press, no restart needed */
+		m_monitor->setInterval(i);
+		return;
 	}
+
+	/* daemonFinished() starts it again with the new interval */
+	if (old != i && daemon.state() != QProcess::NotRunning)
+		stopDaemon();
 }
 
 void
 KSyndaemon::startMonitoring(void)
 {
-	if (daemon.state() != QProcess::NotRunning)
+	if (m_monitor->isAvailable()) {
+		m_monitor->start();
 		return;
+	}
 
-	daemon.setShellCommand(m_cmd + QString::number(m_interval) + " >/dev/null");
-	daemon.start();
+	m_wanted = true;
+	if (daemon.state() == QProcess::NotRunning)
+		startDaemon();
 }
 
 void
 KSyndaemon::stopMonitoring(void)
 {
-	if (daemon.state() == QProcess::Running) {
-		daemon.terminate();
-		daemon.waitForFinished();
+	m_monitor->stop();
+
+	m_wanted = false;
+	if (daemon.state() != QProcess::NotRunning)
+		stopDaemon();
+}
+
+void
+KSyndaemon::startDaemon(void)
+{
+	/* syndaemon takes whole seconds */
+	unsigned seconds = (m_interval + 999) / 1000;
+	if (seconds == 0)
+		seconds = 1;
+
+	daemon.setProgram("syndaemon", QStringList() << "-R" << "-i" << QString::number(seconds));
+	daemon.start();
+}
+
+void
+KSyndaemon::stopDaemon(void)
+{
+	if (m_stopping)
+		return;
+
+	m_stopping = true;
+	daemon.terminate();
+	m_killTimer.start();
+}
+
+void
+KSyndaemon::killDaemon(void)
+{
+	kDebug() << "syndaemon ignored SIGTERM, killing it";
+	daemon.kill();
+}
+
+void
+KSyndaemon::daemonFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+	bool requested = m_stopping;
+
+	m_killTimer.stop();
+	m_stopping = false;
+
+	if (!requested) {
+		/* restarting something that keeps failing would only spin */
+		kDebug() << "syndaemon exited by itself, code" << exitCode << "status" << exitStatus;
+		m_wanted = false;
+		return;
 	}
+
+	if (m_wanted)
+		startDaemon();
+}
+
+void
+KSyndaemon::daemonFailed(QProcess::ProcessError error)
+{
+	if (error != QProcess::FailedToStart)
+		return;
+
+	kDebug() << "cannot run syndaemon:" << daemon.errorString();
+	m_wanted = false;
 }
 
 #include "ksyndaemon.moc"
@@ -23,6 +23,11 @@
 
 #include <KUniqueApplication>
 #include <KProcess>
+#include <QTimer>
+
+class KeyboardMonitor;
+class TouchpadService;
+class TouchpadWatcher;
 
 class KSyndaemon : public KUniqueApplication
 {
@@ -34,14 +39,35 @@ class KSyndaemon : public KUniqueApplication
 		~KSyndaemon();
 
 	public Q_SLOTS:
+		/* milliseconds */
 		void setInterval(unsigned i);
 		void startMonitoring(void);
 		void stopMonitoring(void);
 
+	private Q_SLOTS:
+		void daemonFinished(int exitCode, QProcess::ExitStatus exitStatus);
+		void daemonFailed(QProcess::ProcessError error);
+		void killDaemon(void);
+
 	private:
+		void startDaemon(void);
+		void stopDaemon(void);
+
 		unsigned m_interval;
-		QString m_cmd;
+		/*
+		 * syndaemon is run only when the monitor is not available.
+		 * Nothing here waits for it: stopping sends SIGTERM, escalated
+		 * to SIGKILL by m_killTimer, and the exit is handled in
+		 * daemonFinished(), which starts it again if still wanted.
+		 */
 		KProcess daemon;
+		bool m_wanted;
+		bool m_stopping;
+		QTimer m_killTimer;
+		/* owns the X connection, the others work on it */
+		TouchpadService *m_service;
+		KeyboardMonitor *m_monitor;
+		TouchpadWatcher *m_watcher;
 };
 
 #endif
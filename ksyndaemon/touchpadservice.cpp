@@ -0,0 +1,419 @@
+/*
+   Copyright (C) 2009 by Andrey Borzenkov <arvidjaar at mail.ru>
+
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+ */
+
+#include <QFile>
+#include <QSocketNotifier>
+#include <QTime>
+#include <kdebug.h>
+
+#include <string.h>
+
+#include "touchpadservice.h"
+#include "keyboardmonitor.h"
+#include "touchpadwatcher.h"
+#include "touchpad.h"
+
+static QVariantMap
+toVariantMap(const param_values &values)
+{
+	QVariantMap map;
+
+	for (param_values::const_iterator it = values.begin(); it != values.end(); ++it)
+		map.insert(it->first, it->second);
+	return map;
+}
+
+TouchpadService::TouchpadService(QObject *parent)
+	: QObject(parent),
+	m_available(false),
+	m_notifier(0),
+	m_monitor(0),
+	m_watcher(0),
+	m_traceTimer(),
+	m_queuedTimer()
+{
+	m_traceTimer.setInterval(1000);
+	connect(&m_traceTimer, SIGNAL(timeout()), this, SLOT(flushTrace()));
+	m_queuedTimer.setSingleShot(true);
+	m_queuedTimer.setInterval(0);
+	connect(&m_queuedTimer, SIGNAL(timeout()), this, SLOT(eventsPending()));
+
+	int status = Touchpad::init_xinput_extension();
+	if (status == GET_DISPLAY_FAILED) {
+		kDebug() << "No XInput display, the touchpad service stays empty";
+		return;
+	}
+	/* hierarchy events are selected, a touchpad plugged in later is served */
+	if (status < 0)
+		kDebug() << "No touchpad found yet";
+
+	m_available = true;
+	/* the fake backend has no connection to watch */
+	if (Touchpad::connection_number() >= 0) {
+		m_notifier = new QSocketNotifier(Touchpad::connection_number(), QSocketNotifier::Read, this);
+		connect(m_notifier, SIGNAL(activated(int)), this, SLOT(eventsPending()));
+	}
+	/* opening the devices read some already */
+	checkQueuedEvents();
+}
+
+TouchpadService::~TouchpadService(void)
+{
+	/* before the trace goes with the display */
+	m_analyses.stop();
+	Touchpad::free_xinput_extension();
+}
+
+void
+TouchpadService::checkQueuedEvents(void)
+{
+	if (Touchpad::events_queued())
+		m_queuedTimer.start();
+}
+
+bool
+TouchpadService::isAvailable(void) const
+{
+	return m_available;
+}
+
+void
+TouchpadService::setKeyboardMonitor(KeyboardMonitor *monitor)
+{
+	m_monitor = monitor;
+}
+
+void
+TouchpadService::setWatcher(TouchpadWatcher *watcher)
+{
+	m_watcher = watcher;
+}
+
+QVariantList
+TouchpadService::devices(void)
+{
+	QVariantList ids;
+	const device_list &devices = Touchpad::get_devices();
+
+	for (device_list::const_iterator it = devices.begin(); it != devices.end(); it++)
+		ids.append(*it);
+	return ids;
+}
+
+QString
+TouchpadService::deviceName(int device)
+{
+	return QString::fromLocal8Bit(Touchpad::get_device_name(device));
+}
+
+QStringList
+TouchpadService::properties(void)
+{
+	QStringList names;
+	const prop_list *properties = Touchpad::get_properties_list();
+
+	if (!properties)
+		return names;
+	for (prop_list::const_iterator it = properties->begin(); it != properties->end(); it++)
+		names.append(*it);
+	return names;
+}
+
+QVariantMap
+TouchpadService::parameters(int device)
+{
+	param_values values;
+
+	if (!Touchpad::select_device(device))
+		return QVariantMap();
+
+	for (int j = 0; params[j].name; j++)
+		values[params[j].name] = 0;
+	/* drops what the device does not have */
+	Touchpad::get_parameters(values);
+	return toVariantMap(values);
+}
+
+double
+TouchpadService::parameter(int device, const QString &name)
+{
+	QByteArray key = name.toLatin1();
+	double value;
+
+	if (!Touchpad::select_device(device))
+		return -1;
+
+	for (int j = 0; params[j].name; j++) {
+		if (strcasecmp(params[j].name, key.constData()))
+			continue;
+		return Touchpad::get_parameter((ParamId)j, value) ? value : -1;
+	}
+	return -1;
+}
+
+bool
+TouchpadService::setParameter(int device, const QString &name, double value)
+{
+	QVariantMap values;
+
+	values.insert(name, value);
+	return setParameters(device, values) >= 0;
+}
+
+int
+TouchpadService::setParameters(int device, const QVariantMap &values)
+{
+	if (!Touchpad::select_device(device))
+		return -1;
+
+	Touchpad::Transaction transaction;
+	transaction.begin();
+	for (QVariantMap::const_iterator it = values.constBegin(); it != values.constEnd(); ++it)
+		transaction.set(it.key().toLatin1().constData(), it.value().toDouble());
+	int count = transaction.commit();
+	checkQueuedEvents();
+	return count;
+}
+
+bool
+TouchpadService::saveSnapshot(int device, const QString &path)
+{
+	return Touchpad::select_device(device) &&
+	       Touchpad::save_snapshot(QFile::encodeName(path).constData());
+}
+
+int
+TouchpadService::restoreSnapshot(int device, const QString &path)
+{
+	if (!Touchpad::select_device(device))
+		return -1;
+	int restored = Touchpad::restore_snapshot(QFile::encodeName(path).constData());
+	checkQueuedEvents();
+	return restored;
+}
+
+bool
+TouchpadService::startTrace(int device, const QString &path)
+{
+	stopRawEvents();
+	bool started = Touchpad::select_device(device) &&
+		       Touchpad::start_trace(QFile::encodeName(path).constData());
+	/* the device was queried */
+	checkQueuedEvents();
+	if (!started)
+		return false;
+
+	m_traceTimer.start();
+	return true;
+}
+
+void
+TouchpadService::stopTrace(void)
+{
+	/* not the one of the tap analysis */
+	if (!m_traceTimer.isActive())
+		return;
+
+	m_traceTimer.stop();
+	Touchpad::stop_trace();
+	checkQueuedEvents();
+}
+
+bool
+TouchpadService::startTapAnalysis(int device)
+{
+	stopRawEvents();
+	bool started = Touchpad::select_device(device) && m_analyses.start_tap_latency();
+	checkQueuedEvents();
+	return started;
+}
+
+void
+TouchpadService::stopTapAnalysis(void)
+{
+	if (!m_analyses.tap_latency())
+		return;
+
+	m_analyses.stop();
+	checkQueuedEvents();
+}
+
+QVariantMap
+TouchpadService::tapLatency(void)
+{
+	TapLatency *tapLatency = m_analyses.tap_latency();
+	QVariantMap latency;
+
+	if (!tapLatency)
+		return latency;
+
+	latency.insert("taps", tapLatency->taps());
+	latency.insert("p50", tapLatency->percentile(0.50));
+	latency.insert("p95", tapLatency->percentile(0.95));
+	latency.insert("p99", tapLatency->percentile(0.99));
+	latency.insert("estimated", tapLatency->estimated());
+	return latency;
+}
+
+bool
+TouchpadService::startCalibration(int device)
+{
+	stopRawEvents();
+	bool started = Touchpad::select_device(device) && m_analyses.start_calibration();
+	checkQueuedEvents();
+	return started;
+}
+
+void
+TouchpadService::stopCalibration(void)
+{
+	if (!m_analyses.calibrator())
+		return;
+
+	m_analyses.stop();
+	checkQueuedEvents();
+}
+
+QVariantMap
+TouchpadService::calibration(void)
+{
+	EdgeCalibrator *calibrator = m_analyses.calibrator();
+	QVariantMap result;
+	param_values values;
+
+	if (!calibrator)
+		return result;
+
+	if (calibrator->propose(values))
+		result = toVariantMap(values);
+	result.insert("samples", (qulonglong)calibrator->samples());
+	return result;
+}
+
+bool
+TouchpadService::startHeatmap(int device)
+{
+	stopRawEvents();
+	bool started = Touchpad::select_device(device) && m_analyses.start_heatmap();
+	checkQueuedEvents();
+	return started;
+}
+
+void
+TouchpadService::stopHeatmap(void)
+{
+	if (!m_analyses.heatmap())
+		return;
+
+	m_analyses.stop();
+	checkQueuedEvents();
+}
+
+QVariantList
+TouchpadService::heatmapChanges(void)
+{
+	TouchHeatmap *heatmap = m_analyses.heatmap();
+	QVariantList changes;
+	unsigned cells[HEATMAP_CELLS];
+
+	if (!heatmap)
+		return changes;
+
+	unsigned n = heatmap->take_changes(cells, HEATMAP_CELLS);
+	for (unsigned k = 0; k < n; k++)
+		changes << cells[k] << (qulonglong)heatmap->count(cells[k]);
+	return changes;
+}
+
+/*
+ * The trace and the analyses all take the raw events of one device;
+ * starting one ends the others.
+ */
+void
+TouchpadService::stopRawEvents(void)
+{
+	stopTrace();
+	m_analyses.stop();
+	checkQueuedEvents();
+}
+
+/*
+ * Writes out the queued events; once a second the write is a few hundred
+ * bytes at most.
+ */
+void
+TouchpadService::flushTrace(void)
+{
+	Touchpad::flush_trace();
+	/* the device went away */
+	if (Touchpad::get_trace_device() == -1)
+		m_traceTimer.stop();
+}
+
+/*
+ * Refreshes the mirror and tells the clients what changed, whoever changed
+ * it; the clients' own writes come back this way too.
+ */
+void
+TouchpadService::eventsPending(void)
+{
+	device_changes changed;
+	device_list added, removed;
+	QTime received;
+
+	received.start();
+	Touchpad::process_events(changed, &added, &removed);
+
+	if (m_watcher)
+		m_watcher->eventsProcessed(changed, added, received);
+
+	m_analyses.events_processed();
+
+	for (device_changes::const_iterator it = changed.begin(); it != changed.end(); ++it) {
+		param_values values;
+
+		if (!Touchpad::select_device(it->first))
+			continue;	/* unplugged meanwhile */
+
+		m_analyses.parameters_changed(it->first);
+
+		for (int j = 0; params[j].name; j++) {
+			for (prop_list::const_iterator p = it->second.begin(); p != it->second.end(); p++) {
+				if (!strcmp(params[j].prop_name, *p)) {
+					values[params[j].name] = 0;
+					break;
+				}
+			}
+		}
+		Touchpad::get_parameters(values);
+		emit parametersChanged(it->first, toVariantMap(values));
+	}
+
+	if (!added.empty() || !removed.empty())
+		emit devicesChanged();
+
+	if (m_monitor)
+		m_monitor->eventsProcessed();
+
+	/* restoring a plugged in device reads replies as well */
+	checkQueuedEvents();
+}
+
+#include "touchpadservice.moc"
@@ -0,0 +1,159 @@
+/*
+   Copyright (C) 2009 by Andrey Borzenkov <arvidjaar at mail.ru>
+
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+ */
+
+#ifndef TOUCHPADSERVICE_H
+#define TOUCHPADSERVICE_H
+
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+#include <QVariantMap>
+
+#include "touchpad_analyses.h"
+
+class QSocketNotifier;
+class KeyboardMonitor;
+class TouchpadWatcher;
+
+/*
+ * Keeps the one X connection of ksyndaemon, with the property mirror of
+ * every touchpad kept current by property notify events, and offers the
+ * touchpad parameters over D-Bus. The control module and kcminit use it
+ * instead of opening the display themselves while ksyndaemon runs.
+ *
+ * Parameters are passed by name, as in the params[] table, with double
+ * values; -1 leaves a parameter alone.
+ */
+class TouchpadService : public QObject
+{
+	Q_OBJECT
+	Q_CLASSINFO("D-Bus Interface", "org.kde.Touchpad")
+
+	public:
+		TouchpadService(QObject *parent = 0);
+		~TouchpadService();
+
+		/* the display is open, with or without touchpads */
+		bool isAvailable(void) const;
+		/* told about key presses, which come on the same connection */
+		void setKeyboardMonitor(KeyboardMonitor *monitor);
+		/* told about new devices and property changes first */
+		void setWatcher(TouchpadWatcher *watcher);
+		/*
+		 * To be called after using the connection outside
+		 * eventsPending(): events read into the queue of Xlib by
+		 * replies are processed soon instead of with the next traffic
+		 */
+		void checkQueuedEvents(void);
+
+	public Q_SLOTS:
+		/* device ids */
+		QVariantList devices(void);
+		QString deviceName(int device);
+		/* synaptics properties known to the server */
+		QStringList properties(void);
+
+		/* every readable parameter of the device, from the mirror */
+		QVariantMap parameters(int device);
+		double parameter(int device, const QString &name);
+
+		bool setParameter(int device, const QString &name, double value);
+		/* sent at once, one property change per property */
+		int setParameters(int device, const QVariantMap &values);
+
+		/*
+		 * Saves every property of the device to a snapshot file, or
+		 * puts them back from it (see Touchpad::save_snapshot())
+		 */
+		bool saveSnapshot(int device, const QString &path);
+		int restoreSnapshot(int device, const QString &path);
+
+		/*
+		 * Records the raw events of the device to a trace file until
+		 * stopTrace() or until the device goes away. The file is
+		 * written once a second.
+		 */
+		bool startTrace(int device, const QString &path);
+		void stopTrace(void);
+
+		/*
+		 * Measures how long the clicks of taps on the device take to
+		 * come, under its current parameters, until stopTapAnalysis().
+		 * Cannot run along with a trace.
+		 */
+		bool startTapAnalysis(int device);
+		void stopTapAnalysis(void);
+		/*
+		 * "taps" measured so far and the "p50", "p95" and "p99"
+		 * delays in ms, -1 without taps; "estimated" when the
+		 * device reports no pressure (see TapLatency)
+		 */
+		QVariantMap tapLatency(void);
+
+		/*
+		 * Collects the positions the device reports while the finger
+		 * sweeps over all of it, until stopCalibration(). Needs
+		 * absolute coordinates; cannot run along with a trace or the
+		 * tap analysis.
+		 */
+		bool startCalibration(int device);
+		void stopCalibration(void);
+		/*
+		 * "samples" collected so far and, once there are enough, the
+		 * proposed edge and area parameters (see EdgeCalibrator)
+		 */
+		QVariantMap calibration(void);
+
+		/*
+		 * Counts where the finger touches the device, in the grid of
+		 * TouchHeatmap, until stopHeatmap(). Cannot run along with a
+		 * trace or the analyses.
+		 */
+		bool startHeatmap(int device);
+		void stopHeatmap(void);
+		/*
+		 * Cells whose count changed since the last call, as pairs of
+		 * cell index and count; all cells change to 0 when the edges
+		 * of the device move the grid
+		 */
+		QVariantList heatmapChanges(void);
+
+	Q_SIGNALS:
+		/* new values of the parameters of the properties which changed */
+		void parametersChanged(int device, const QVariantMap &values);
+		void devicesChanged(void);
+
+	private Q_SLOTS:
+		void eventsPending(void);
+		void flushTrace(void);
+
+	private:
+		void stopRawEvents(void);
+
+		bool m_available;
+		QSocketNotifier *m_notifier;
+		KeyboardMonitor *m_monitor;
+		TouchpadWatcher *m_watcher;
+		QTimer m_traceTimer;
+		QTimer m_queuedTimer;
+		RawEventAnalyses m_analyses;
+};
+
+#endif
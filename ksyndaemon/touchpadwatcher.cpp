@@ -0,0 +1,100 @@
+/*
+   Copyright (C) 2009 by Andrey Borzenkov <arvidjaar at mail.ru>
+
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+ */
+
+#include <kdebug.h>
+
+#include "touchpadwatcher.h"
+#include "touchpadservice.h"
+#include "keyboardmonitor.h"
+
+TouchpadWatcher::TouchpadWatcher(TouchpadService *service, KeyboardMonitor *monitor,
+				 QObject *parent)
+	: QObject(parent),
+	m_monitor(monitor)
+{
+	/* without touchpads yet too, so the first one plugged in is kept */
+	const device_list &devices = Touchpad::get_devices();
+	for (device_list::const_iterator it = devices.begin(); it != devices.end(); it++)
+		capture(*it);
+
+	service->setWatcher(this);
+}
+
+void
+TouchpadWatcher::eventsProcessed(const device_changes &changed, const device_list &added,
+				 const QTime &received)
+{
+	if (changed.empty() && added.empty())
+		return;
+
+	int previous = Touchpad::get_current_device();
+
+	/* first, every millisecond the touchpad behaves differently counts */
+	for (device_list::const_iterator it = added.begin(); it != added.end(); it++)
+		restore(*it, received);
+
+	/* the values restored come back here too, keeping the state as it is */
+	for (device_changes::const_iterator it = changed.begin(); it != changed.end(); ++it)
+		capture(it->first);
+
+	Touchpad::select_device(previous);
+}
+
+/*
+ * Remembers the current state of the device, from the property mirror.
+ */
+void
+TouchpadWatcher::capture(int device)
+{
+	if (!Touchpad::select_device(device))
+		return;		/* unplugged meanwhile */
+
+	snapshot_properties state;
+	Touchpad::get_device_state(state);
+
+	/* switched off only while typing: what counts is the value it gets back */
+	int off = m_monitor ? m_monitor->pendingTouchpadOff(device) : -1;
+	if (off != -1) {
+		for (snapshot_properties::iterator p = state.begin(); p != state.end(); ++p)
+			if (p->name == SYNAPTICS_PROP_OFF && !p->items.empty())
+				p->items[0] = off;
+	}
+
+	m_states[QString::fromLocal8Bit(Touchpad::get_device_name())] = state;
+}
+
+void
+TouchpadWatcher::restore(int device, const QTime &received)
+{
+	if (!Touchpad::select_device(device))
+		return;
+
+	QString name = QString::fromLocal8Bit(Touchpad::get_device_name());
+	QMap<QString, snapshot_properties>::const_iterator state = m_states.constFind(name);
+	if (state == m_states.constEnd()) {
+		/* nothing known yet, what it has now is the state to keep */
+		capture(device);
+		return;
+	}
+
+	int restored = Touchpad::set_device_state(state.value());
+	kDebug() << "restored" << restored << "properties of" << name
+		 << received.elapsed() << "ms after reading the hierarchy event";
+}
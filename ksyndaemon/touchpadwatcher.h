@@ -0,0 +1,65 @@
+/*
+   Copyright (C) 2009 by Andrey Borzenkov <arvidjaar at mail.ru>
+
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+ */
+
+#ifndef TOUCHPADWATCHER_H
+#define TOUCHPADWATCHER_H
+
+#include <QObject>
+#include <QMap>
+#include <QString>
+#include <QTime>
+
+#include "touchpad.h"
+
+class TouchpadService;
+class KeyboardMonitor;
+
+/*
+ * Puts touchpads back the way they were when the X server re-initializes
+ * them, after resume, a PS/2 reset or a re-plug, and has forgotten every
+ * runtime property value. The last known state of each touchpad is kept
+ * by device name as the raw property contents, updated from the property
+ * notify events the service reads anyway, and pushed as one batch of
+ * property changes as soon as a device with that name appears, without
+ * reading the configuration or the device.
+ */
+class TouchpadWatcher : public QObject
+{
+	public:
+		TouchpadWatcher(TouchpadService *service, KeyboardMonitor *monitor,
+				QObject *parent = 0);
+
+		/*
+		 * called by the service after it has read the pending events,
+		 * which it started doing at received
+		 */
+		void eventsProcessed(const device_changes &changed, const device_list &added,
+				     const QTime &received);
+
+	private:
+		void capture(int device);
+		void restore(int device, const QTime &received);
+
+		KeyboardMonitor *m_monitor;
+		/* device name -> properties */
+		QMap<QString, snapshot_properties> m_states;
+};
+
+#endif
@@ -0,0 +1,372 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+/*
+ * Reads and writes touchpad parameters from scripts, by the names of the
+ * synaptics driver options, like synclient does:
+ *
+ *   touchpad-params [-d DEVICE-ID] dump
+ *   touchpad-params [-d DEVICE-ID] [-n] apply [FILE|-]
+ *   touchpad-params [-d DEVICE-ID] [-n] Name[=value]...
+ *
+ * dump prints every parameter of the device as Name=value lines, grouped
+ * by property, all read in one pass from the property mirror.
+ *
+ * apply reads Name=value lines (blank lines and # comments are skipped)
+ * from FILE or the standard input, the format dump prints, so a dump can
+ * be put back as it is. Every line is checked against the limits of the
+ * parameter first; if any is wrong nothing is written, otherwise the whole
+ * batch goes out with one property change per property. -n only checks.
+ * Values the device already holds are always accepted, including those
+ * of read-only parameters (names starting with '_').
+ *
+ * Name=value arguments are applied the same way; a bare Name prints it.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <string>
+#include <vector>
+
+#include "touchpad.h"
+
+#define LINE_MAX_LENGTH 1024
+
+struct Setting {
+    const struct Parameter *par;
+    double value;
+};
+
+static void
+usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [-d DEVICE-ID] dump\n"
+            "       %s [-d DEVICE-ID] [-n] apply [FILE|-]\n"
+            "       %s [-d DEVICE-ID] [-n] Name[=value]...\n",
+            program, program, program);
+    exit(2);
+}
+
+static char *
+trim(char *s)
+{
+    while (isspace((unsigned char)*s))
+        s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+    return s;
+}
+
+static const struct Parameter *
+find_parameter(const char *name)
+{
+    for (int j = 0; params[j].name; j++)
+        if (!strcasecmp(params[j].name, name))
+            return &params[j];
+    return NULL;
+}
+
+static void
+print_value(const struct Parameter *par, double value)
+{
+    if (par->type == PT_DOUBLE)
+        printf("%s=%g\n", par->name, value);
+    else
+        printf("%s=%d\n", par->name, (int)value);
+}
+
+/*
+ * Checks "Name=value" against the parameter table and the current device;
+ * returns an error message, or NULL with setting filled in.
+ */
+static const char *
+parse_setting(char *text, Setting& setting)
+{
+    static std::string message;
+
+    char *eq = strchr(text, '=');
+    if (!eq)
+        return "expected Name=value";
+    *eq = '\0';
+    char *name = trim(text);
+    char *value = trim(eq + 1);
+
+    setting.par = find_parameter(name);
+    if (!setting.par) {
+        message = std::string("unknown parameter '") + name + "'";
+        return message.c_str();
+    }
+    ParamId id = (ParamId)(setting.par - params);
+    if (!Touchpad::available(id)) {
+        message = std::string(setting.par->name) + " is not supported by this device";
+        return message.c_str();
+    }
+
+    char *end;
+    errno = 0;
+    setting.value = strtod(value, &end);
+    if (!*value || *end || errno) {
+        message = std::string(setting.par->name) + ": '" + value + "' is not a number";
+        return message.c_str();
+    }
+    if (setting.par->type != PT_DOUBLE && setting.value != (int)setting.value) {
+        message = std::string(setting.par->name) + " takes whole numbers";
+        return message.c_str();
+    }
+
+    /* what the device holds is always fine, so a dump can be put back
+     * even where the driver defaults lie outside the table's limits */
+    if ((float)Touchpad::get_double(id) == (float)setting.value)
+        return NULL;
+    if (setting.par->name[0] == '_') {
+        message = std::string(setting.par->name) + " is read-only";
+        return message.c_str();
+    }
+    if (setting.value < setting.par->min_val || setting.value > setting.par->max_val) {
+        char range[64];
+        snprintf(range, sizeof(range), " is out of range [%g, %g]",
+                 setting.par->min_val, setting.par->max_val);
+        message = std::string(setting.par->name) + range;
+        return message.c_str();
+    }
+
+    return NULL;
+}
+
+static int
+dump()
+{
+    param_values values;
+    for (int j = 0; params[j].name; j++)
+        values[params[j].name] = 0;
+    Touchpad::get_parameters(values);
+
+    printf("# %d %s\n", Touchpad::get_current_device(), Touchpad::get_device_name());
+
+    /* properties in the order of their first parameter in the table */
+    std::vector<const char *> props;
+    for (int j = 0; params[j].name; j++) {
+        size_t k = 0;
+        while (k < props.size() && strcmp(props[k], params[j].prop_name))
+            k++;
+        if (k == props.size())
+            props.push_back(params[j].prop_name);
+    }
+
+    for (size_t k = 0; k < props.size(); k++) {
+        bool header = false;
+        for (int j = 0; params[j].name; j++) {
+            if (strcmp(params[j].prop_name, props[k]))
+                continue;
+            param_values::const_iterator it = values.find(params[j].name);
+            if (it == values.end())
+                continue;
+            if (!header) {
+                printf("# %s\n", props[k]);
+                header = true;
+            }
+            print_value(&params[j], it->second);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Writes the settings with one transaction, or nothing when check_only.
+ * Later settings of the same parameter win; properties holding their
+ * values already are left alone.
+ */
+static int
+apply_settings(const std::vector<Setting>& settings, bool check_only)
+{
+    if (check_only || settings.empty())
+        return 0;
+
+    param_values current;
+    Touchpad::Transaction transaction;
+    transaction.begin();
+    for (size_t j = 0; j < settings.size(); j++) {
+        current[settings[j].par->name] = 0;
+        if (settings[j].par->name[0] != '_')
+            transaction.set((ParamId)(settings[j].par - params), settings[j].value);
+    }
+    Touchpad::get_parameters(current);
+    int changed = transaction.commit(current);
+
+    fprintf(stderr, "%d properties changed\n", changed);
+    return 0;
+}
+
+static int
+apply_file(const char *path, bool check_only)
+{
+    bool from_stdin = !strcmp(path, "-");
+    FILE *file = from_stdin ? stdin : fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+    const char *label = from_stdin ? "<stdin>" : path;
+
+    std::vector<Setting> settings;
+    char line[LINE_MAX_LENGTH];
+    int number = 0, errors = 0;
+    while (fgets(line, sizeof(line), file)) {
+        number++;
+        size_t length = strlen(line);
+        if (length == sizeof(line) - 1 && line[length - 1] != '\n' && !feof(file)) {
+            fprintf(stderr, "%s:%d: line too long\n", label, number);
+            errors++;
+            int c;
+            while ((c = fgetc(file)) != EOF && c != '\n')
+                ;
+            continue;
+        }
+
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+        char *text = trim(line);
+        if (!*text)
+            continue;
+
+        Setting setting;
+        const char *error = parse_setting(text, setting);
+        if (error) {
+            fprintf(stderr, "%s:%d: %s\n", label, number, error);
+            errors++;
+        } else
+            settings.push_back(setting);
+    }
+    bool failed = ferror(file);
+    if (failed)
+        perror(label);
+    if (!from_stdin)
+        fclose(file);
+
+    if (failed)
+        return 1;
+    if (errors) {
+        fprintf(stderr, "%d invalid settings, nothing applied\n", errors);
+        return 1;
+    }
+    return apply_settings(settings, check_only);
+}
+
+static int
+apply_arguments(char **args, int count, bool check_only)
+{
+    std::vector<Setting> settings;
+    int errors = 0;
+
+    for (int j = 0; j < count; j++) {
+        std::string arg(args[j]);
+        if (arg.find('=') == std::string::npos) {
+            const struct Parameter *par = find_parameter(args[j]);
+            double value;
+            if (!par || !Touchpad::get_parameter((ParamId)(par - params), value)) {
+                fprintf(stderr, "%s: unknown or unsupported parameter\n", args[j]);
+                errors++;
+            } else
+                print_value(par, value);
+            continue;
+        }
+
+        Setting setting;
+        std::vector<char> text(arg.begin(), arg.end());
+        text.push_back('\0');
+        const char *error = parse_setting(&text[0], setting);
+        if (error) {
+            fprintf(stderr, "%s\n", error);
+            errors++;
+        } else
+            settings.push_back(setting);
+    }
+
+    if (errors) {
+        if (!settings.empty())
+            fprintf(stderr, "%d invalid settings, nothing applied\n", errors);
+        return 1;
+    }
+    return apply_settings(settings, check_only);
+}
+
+int
+main(int argc, char **argv)
+{
+    int device = -1;
+    bool check_only = false;
+    int arg = 1;
+
+    while (arg < argc && argv[arg][0] == '-' && argv[arg][1]) {
+        if (!strcmp(argv[arg], "-d") && arg + 1 < argc) {
+            char *end;
+            device = strtol(argv[arg + 1], &end, 10);
+            if (*end || !*argv[arg + 1])
+                usage(argv[0]);
+            arg += 2;
+        } else if (!strcmp(argv[arg], "-n")) {
+            check_only = true;
+            arg++;
+        } else
+            usage(argv[0]);
+    }
+    if (arg == argc)
+        usage(argv[0]);
+
+    bool dumping = !strcmp(argv[arg], "dump");
+    bool applying = !strcmp(argv[arg], "apply");
+    if ((dumping && argc - arg != 1) || (applying && argc - arg > 2))
+        usage(argv[0]);
+
+    if (Touchpad::init_xinput_extension() < 0) {
+        fprintf(stderr, "No synaptics touchpad found.\n");
+        return 1;
+    }
+    if (device >= 0 && !Touchpad::select_device(device)) {
+        fprintf(stderr, "No synaptics device %d.\n", device);
+        Touchpad::free_xinput_extension();
+        return 1;
+    }
+
+    int status;
+    if (dumping)
+        status = dump();
+    else if (applying)
+        status = apply_file(arg + 1 < argc ? argv[arg + 1] : "-", check_only);
+    else
+        status = apply_arguments(argv + arg, argc - arg, check_only);
+
+    /* sends what is still buffered */
+    Touchpad::free_xinput_extension();
+    return status;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+/*
+ * Saves the state of the touchpads to a snapshot file or puts it back,
+ * e.g. after resume or an X restart:
+ *
+ *   touchpad-snapshot save|restore FILE [DEVICE-ID...]
+ *
+ * Without ids every synaptics device is handled. Restoring needs no saved
+ * configuration; each device gets one property change per property.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "touchpad.h"
+
+static void
+usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s save|restore FILE [DEVICE-ID...]\n", program);
+    exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc < 3)
+        usage(argv[0]);
+
+    bool save = !strcmp(argv[1], "save");
+    if (!save && strcmp(argv[1], "restore"))
+        usage(argv[0]);
+    const char *path = argv[2];
+
+    if (Touchpad::init_xinput_extension() < 0) {
+        fprintf(stderr, "No synaptics touchpad found.\n");
+        return 1;
+    }
+
+    device_list ids;
+    if (argc > 3)
+        for (int j = 3; j < argc; j++)
+            ids.push_back(atoi(argv[j]));
+    else
+        ids = Touchpad::get_devices();
+
+    int failed = 0;
+    for (device_list::const_iterator it = ids.begin(); it != ids.end(); ++it) {
+        if (!Touchpad::select_device(*it)) {
+            fprintf(stderr, "No synaptics device %d.\n", *it);
+            failed++;
+            continue;
+        }
+
+        const char *name = Touchpad::get_device_name();
+        if (save) {
+            if (Touchpad::save_snapshot(path))
+                printf("%d %s: saved\n", *it, name);
+            else
+                failed++;
+            continue;
+        }
+
+        int restored = Touchpad::restore_snapshot(path);
+        if (restored < 0) {
+            fprintf(stderr, "%d %s: not in %s\n", *it, name, path);
+            failed++;
+        } else
+            printf("%d %s: %d properties restored\n", *it, name, restored);
+    }
+
+    /* sends what is still buffered */
+    Touchpad::free_xinput_extension();
+    return failed ? 1 : 0;
+}
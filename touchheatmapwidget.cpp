@@ -0,0 +1,121 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#include <QPainter>
+#include <QPaintEvent>
+
+#include <string.h>
+
+#include "touchheatmapwidget.h"
+#include "touchpad_calibrate.h"
+
+// shades from a single touch to 2^(Levels - 2) touches and more
+static const int Levels = 16;
+
+static int level(unsigned long count)
+{
+    int shade = 0;
+    while (count && shade < Levels - 1) {
+        count >>= 1;
+        shade++;
+    }
+    return shade;
+}
+
+// from cold blue to hot red
+static QColor shade(int level)
+{
+    return QColor::fromHsv(240 - 240 * (level - 1) / (Levels - 2), 255, 255);
+}
+
+TouchHeatmapWidget::TouchHeatmapWidget(QWidget* parent)
+    : QWidget(parent)
+{
+    memset(levels, 0, sizeof(levels));
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+}
+
+QSize TouchHeatmapWidget::sizeHint() const
+{
+    return QSize(HEATMAP_COLUMNS * 5, HEATMAP_ROWS * 5);
+}
+
+QRect TouchHeatmapWidget::cellRect(int cell) const
+{
+    int column = cell % HEATMAP_COLUMNS;
+    int row = cell / HEATMAP_COLUMNS;
+    int left = column * width() / HEATMAP_COLUMNS;
+    int top = row * height() / HEATMAP_ROWS;
+    return QRect(left, top, (column + 1) * width() / HEATMAP_COLUMNS - left,
+                 (row + 1) * height() / HEATMAP_ROWS - top);
+}
+
+void TouchHeatmapWidget::setCells(const QMap<int, unsigned long>& cells)
+{
+    QRegion dirty;
+    for (QMap<int, unsigned long>::const_iterator it = cells.constBegin(); it != cells.constEnd(); ++it) {
+        if (it.key() < 0 || it.key() >= HEATMAP_CELLS)
+            continue;
+        int shade = level(it.value());
+        if (shade == levels[it.key()])
+            continue;
+        levels[it.key()] = shade;
+        dirty += cellRect(it.key());
+    }
+    // merged with other updates until the next paint
+    if (!dirty.isEmpty())
+        update(dirty);
+}
+
+void TouchHeatmapWidget::clear()
+{
+    memset(levels, 0, sizeof(levels));
+    update();
+}
+
+void TouchHeatmapWidget::paintEvent(QPaintEvent* event)
+{
+    QPainter painter(this);
+    const QRect& exposed = event->rect();
+    QColor background = palette().color(QPalette::Base);
+
+    int first = qMax(0, exposed.top() * HEATMAP_ROWS / height()) * HEATMAP_COLUMNS;
+    int last = qMin(HEATMAP_ROWS, exposed.bottom() * HEATMAP_ROWS / height() + 1) * HEATMAP_COLUMNS;
+    for (int cell = first; cell < last; cell++) {
+        QRect rect = cellRect(cell);
+        if (!event->region().intersects(rect))
+            continue;
+        painter.fillRect(rect, levels[cell] ? shade(levels[cell]) : background);
+    }
+
+    // the edges lie a fixed share of the touchpad in, see TouchHeatmap
+    int left = (int)(width() * EDGE_INSET_X);
+    int top = (int)(height() * EDGE_INSET_Y);
+    painter.setPen(QPen(palette().color(QPalette::Text), 1, Qt::DashLine));
+    painter.drawRect(left, top, width() - 2 * left - 1, height() - 2 * top - 1);
+}
+
+#include "touchheatmapwidget.moc"
@@ -0,0 +1,65 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#ifndef _TOUCHHEATMAPWIDGET_H
+#define _TOUCHHEATMAPWIDGET_H
+
+#include <QMap>
+#include <QWidget>
+
+#include "touchpad_heatmap.h"
+
+class QPaintEvent;
+
+/*
+ * Shows the counts of a TouchHeatmap, one rectangle per cell, with the
+ * touchpad edges drawn over them. A cell's colour depends on its count
+ * alone (doubling the count goes one shade further), so when counts
+ * change only the cells whose shade changed are repainted.
+ */
+class TouchHeatmapWidget : public QWidget
+{
+  Q_OBJECT
+
+public:
+    TouchHeatmapWidget(QWidget* parent = 0);
+
+    /* cell -> count, as from TouchpadClient::heatmapChanges() */
+    void setCells(const QMap<int, unsigned long>& cells);
+    void clear();
+
+    QSize sizeHint() const;
+
+protected:
+    void paintEvent(QPaintEvent* event);
+
+private:
+    QRect cellRect(int cell) const;
+
+    /* shade of each cell, 0 for no touches */
+    unsigned char levels[HEATMAP_CELLS];
+};
+
+#endif
@@ -29,48 +29,276 @@
 #include <X11/Xatom.h>
 #include <X11/extensions/XI.h>
 #include <X11/extensions/XInput.h>
+#include <X11/extensions/XInput2.h>
 
 #include <strings.h>
 #include <string.h>
 #include <math.h>
 #include <map>
+#include <vector>
+#include <bitset>
+#include <algorithm>
 
 #include "touchpad.h"
+#include "touchpad_backend.h"
+#include "touchpad_trace.h"
+#include "touchpad_snapshot.h"
 
-int xi_opcode;
+const struct Parameter params[] = {
+    {"LeftEdge",              PT_INT,    0, 10000, SYNAPTICS_PROP_EDGES,	32,	0},
+    {"RightEdge",             PT_INT,    0, 10000, SYNAPTICS_PROP_EDGES,	32,	1},
+    {"TopEdge",               PT_INT,    0, 10000, SYNAPTICS_PROP_EDGES,	32,	2},
+    {"BottomEdge",            PT_INT,    0, 10000, SYNAPTICS_PROP_EDGES,	32,	3},
+    {"FingerLow",             PT_INT,    0, 255,   SYNAPTICS_PROP_FINGER,	32,	0},
+    {"FingerHigh",            PT_INT,    0, 255,   SYNAPTICS_PROP_FINGER,	32,	1},
+    {"FingerPress",           PT_INT,    0, 256,   SYNAPTICS_PROP_FINGER,	32,	2},
+    {"MaxTapTime",            PT_INT,    0, 1000,  SYNAPTICS_PROP_TAP_TIME,	32,	0},
+    {"MaxTapMove",            PT_INT,    0, 2000,  SYNAPTICS_PROP_TAP_MOVE,	32,	0},
+    {"MaxDoubleTapTime",      PT_INT,    0, 1000,  SYNAPTICS_PROP_TAP_DURATIONS,32,	1},
+    {"SingleTapTimeout",      PT_INT,    0, 1000,  SYNAPTICS_PROP_TAP_DURATIONS,32,	0},
+    {"ClickTime",             PT_INT,    0, 1000,  SYNAPTICS_PROP_TAP_DURATIONS,32,	2},
+    {"FastTaps",              PT_BOOL,   0, 1,     SYNAPTICS_PROP_TAP_FAST,	8,	0},
+    {"EmulateMidButtonTime",  PT_INT,    0, 1000,  SYNAPTICS_PROP_MIDDLE_TIMEOUT,32,	0},
+    {"EmulateTwoFingerMinZ",  PT_INT,    0, 1000,  SYNAPTICS_PROP_TWOFINGER_PRESSURE,	32,	0},
+    {"EmulateTwoFingerMinW",  PT_INT,    0, 15,    SYNAPTICS_PROP_TWOFINGER_WIDTH,	32,	0},
+    {"VertScrollDelta",       PT_INT,    0, 1000,  SYNAPTICS_PROP_SCROLL_DISTANCE,	32,	0},
+    {"HorizScrollDelta",      PT_INT,    0, 1000,  SYNAPTICS_PROP_SCROLL_DISTANCE,	32,	1},
+    {"VertEdgeScroll",        PT_BOOL,   0, 1,     SYNAPTICS_PROP_SCROLL_EDGE,	8,	0},
+    {"HorizEdgeScroll",       PT_BOOL,   0, 1,     SYNAPTICS_PROP_SCROLL_EDGE,	8,	1},
+    {"CornerCoasting",        PT_BOOL,   0, 1,     SYNAPTICS_PROP_SCROLL_EDGE,	8,	2},
+    {"VertTwoFingerScroll",   PT_BOOL,   0, 1,     SYNAPTICS_PROP_SCROLL_TWOFINGER,	8,	0},
+    {"HorizTwoFingerScroll",  PT_BOOL,   0, 1,     SYNAPTICS_PROP_SCROLL_TWOFINGER,	8,	1},
+    {"MinSpeed",              PT_DOUBLE, 0, 1.0,   SYNAPTICS_PROP_SPEED,	0, /*float */	0},
+    {"MaxSpeed",              PT_DOUBLE, 0, 1.0,   SYNAPTICS_PROP_SPEED,	0, /*float */	1},
+    {"AccelFactor",           PT_DOUBLE, 0, 1.0,   SYNAPTICS_PROP_SPEED,	0, /*float */	2},
+    {"TrackstickSpeed",       PT_DOUBLE, 0, 200.0, SYNAPTICS_PROP_SPEED,	0, /*float */ 3},
+    {"EdgeMotionMinZ",        PT_INT,    1, 255,   SYNAPTICS_PROP_EDGEMOTION_PRESSURE,  32,	0},
+    {"EdgeMotionMaxZ",        PT_INT,    1, 255,   SYNAPTICS_PROP_EDGEMOTION_PRESSURE,  32,	1},
+    {"EdgeMotionMinSpeed",    PT_INT,    0, 1000,  SYNAPTICS_PROP_EDGEMOTION_SPEED,     32,	0},
+    {"EdgeMotionMaxSpeed",    PT_INT,    0, 1000,  SYNAPTICS_PROP_EDGEMOTION_SPEED,     32,	1},
+    {"EdgeMotionUseAlways",   PT_BOOL,   0, 1,     SYNAPTICS_PROP_EDGEMOTION,   8,	0},
+    {"UpDownScrolling",       PT_BOOL,   0, 1,     SYNAPTICS_PROP_BUTTONSCROLLING,  8,	0},
+    {"LeftRightScrolling",    PT_BOOL,   0, 1,     SYNAPTICS_PROP_BUTTONSCROLLING,  8,	1},
+    {"UpDownScrollRepeat",    PT_BOOL,   0, 1,     SYNAPTICS_PROP_BUTTONSCROLLING_REPEAT,   8,	0},
+    {"LeftRightScrollRepeat", PT_BOOL,   0, 1,     SYNAPTICS_PROP_BUTTONSCROLLING_REPEAT,   8,	1},
+    {"ScrollButtonRepeat",    PT_INT,    SBR_MIN , SBR_MAX, SYNAPTICS_PROP_BUTTONSCROLLING_TIME, 32,	0},
+    {"TouchpadOff",           PT_INT,    0, 2,     SYNAPTICS_PROP_OFF,		8,	0},
+    {"GuestMouseOff",         PT_BOOL,   0, 1,     SYNAPTICS_PROP_GUESTMOUSE,	8,	0},
+    {"LockedDrags",           PT_BOOL,   0, 1,     SYNAPTICS_PROP_LOCKED_DRAGS,	8,	0},
+    {"LockedDragTimeout",     PT_INT,    0, 30000, SYNAPTICS_PROP_LOCKED_DRAGS_TIMEOUT,	32,	0},
+    {"RTCornerButton",        PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_TAP_ACTION,	8,	0},
+    {"RBCornerButton",        PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_TAP_ACTION,	8,	1},
+    {"LTCornerButton",        PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_TAP_ACTION,	8,	2},
+    {"LBCornerButton",        PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_TAP_ACTION,	8,	3},
+    {"TapButton1",            PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_TAP_ACTION,	8,	4},
+    {"TapButton2",            PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_TAP_ACTION,	8,	5},
+    {"TapButton3",            PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_TAP_ACTION,	8,	6},
+    {"ClickFinger1",          PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_CLICK_ACTION,	8,	0},
+    {"ClickFinger2",          PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_CLICK_ACTION,	8,	1},
+    {"ClickFinger3",          PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_CLICK_ACTION,	8,	2},
+    {"CircularScrolling",     PT_BOOL,   0, 1,     SYNAPTICS_PROP_CIRCULAR_SCROLLING,	8,	0},
+    {"CircScrollDelta",       PT_DOUBLE, .01, 3,   SYNAPTICS_PROP_CIRCULAR_SCROLLING_DIST,	0 /* float */,	0},
+    {"CircScrollTrigger",     PT_INT,    0, 8,     SYNAPTICS_PROP_CIRCULAR_SCROLLING_TRIGGER,	8,	0},
+    {"CircularPad",           PT_BOOL,   0, 1,     SYNAPTICS_PROP_CIRCULAR_PAD,	8,	0},
+    {"PalmDetect",            PT_BOOL,   0, 1,     SYNAPTICS_PROP_PALM_DETECT,	8,	0},
+    {"PalmMinWidth",          PT_INT,    0, 15,    SYNAPTICS_PROP_PALM_DIMENSIONS,	32,	0},
+    {"PalmMinZ",              PT_INT,    0, 255,   SYNAPTICS_PROP_PALM_DIMENSIONS,	32,	1},
+    {"CoastingSpeed",         PT_DOUBLE, 0, 20,    SYNAPTICS_PROP_COASTING_SPEED,	0 /* float*/,	0},
+    {"PressureMotionMinZ",    PT_INT,    1, 255,   SYNAPTICS_PROP_PRESSURE_MOTION,	32,	0},
+    {"PressureMotionMaxZ",    PT_INT,    1, 255,   SYNAPTICS_PROP_PRESSURE_MOTION,	32,	1},
+    {"PressureMotionMinFactor", PT_DOUBLE, 0, 10.0,SYNAPTICS_PROP_PRESSURE_MOTION_FACTOR,	0 /*float*/,	0},
+    {"PressureMotionMaxFactor", PT_DOUBLE, 0, 10.0,SYNAPTICS_PROP_PRESSURE_MOTION_FACTOR,	0 /*float*/,	1},
+    {"GrabEventDevice",       PT_BOOL,   0, 1,     SYNAPTICS_PROP_GRAB,	8,	0},
+    {"TapAndDragGesture",     PT_BOOL,   0, 1,     SYNAPTICS_PROP_GESTURES,	8,	0},
+    {"AreaLeftEdge",          PT_INT,    0, 10000, SYNAPTICS_PROP_AREA,	32,	0},
+    {"AreaRightEdge",         PT_INT,    0, 10000, SYNAPTICS_PROP_AREA,	32,	1},
+    {"AreaTopEdge",           PT_INT,    0, 10000, SYNAPTICS_PROP_AREA,	32,	2},
+    {"AreaBottomEdge",        PT_INT,    0, 10000, SYNAPTICS_PROP_AREA,	32,	3},
+    {"_CapLeftButton",        PT_BOOL,   0, 1,     SYNAPTICS_PROP_CAPABILITIES,	8,	0},
+    {"_CapMiddleButton",      PT_BOOL,   0, 1,     SYNAPTICS_PROP_CAPABILITIES,	8,	1},
+    {"_CapRightButton",       PT_BOOL,   0, 1,     SYNAPTICS_PROP_CAPABILITIES,	8,	2},
+    {"_CapTwoFingers",        PT_BOOL,   0, 1,     SYNAPTICS_PROP_CAPABILITIES,	8,	3},
+    {"_CapThreeFingers",      PT_BOOL,   0, 1,     SYNAPTICS_PROP_CAPABILITIES,	8,	4},
+    { NULL, ParaType(0), 0, 0, 0, 0, 0           }
+};
+
+/* the table and ParamId must list the same parameters */
+typedef char params_match_ids[sizeof(params) / sizeof(params[0]) == PARAM_COUNT + 1 ? 1 : -1];
+
+int xi_opcode           = -1;   /* -1 unless hierarchy events are selected */
 
 Display* display        = NULL;
-XDevice* device         = NULL;
-char* dev_name          = NULL;
 
-struct ltstr
-{
-  bool operator()(const char* s1, const char* s2) const
-  {
-    return strcasecmp(s1, s2) < 0;
-  }
-};
-typedef std::map<const char*, struct Parameter*, ltstr> param_hash;
+typedef std::map<const char*, const struct Parameter*, ltstr> param_hash;
 
 param_hash* parameters_map = NULL;
-prop_list* properties_list = NULL;
+/* distinct properties of all devices, see dp_index_properties() */
+prop_list properties_list;
+
+/* Contents of every synaptics property of a device, see dp_mirror_properties() */
+typedef std::map<Atom, PropertyData> property_mirror;
+int property_event_type = -1;
+
+typedef std::bitset<PARAM_COUNT> param_set;
+
+/* State of one synaptics device */
+struct TouchpadDevice {
+    XDevice* device;
+    char* name;
+    PropertyBackend* backend;
+    property_mirror mirror;
+    /* by ParamId, see dp_index_device() */
+    param_set present;      /* the mirror holds the parameter */
+    param_set lacking;      /* capabilities the device reports it lacks */
+};
+
+/* All synaptics devices by XI device id; API calls work on the current one */
+typedef std::map<int, TouchpadDevice*> touchpad_devices;
+touchpad_devices devices;
+device_list device_ids;
+TouchpadDevice* current = NULL;
+
+/* Raw key presses seen since init, see Touchpad::select_key_events() */
+unsigned long key_presses = 0;
+
+/* Raw event tracing, see Touchpad::start_trace() */
+#define TRACE_RING_SIZE 4096    /* events, about a minute of motion */
+
+TraceRing* trace_ring   = NULL;
+TraceWriter* trace_writer = NULL;
+int trace_device        = -1;
+int trace_axes[TRACE_VALUATORS];    /* valuator numbers, -1 if absent */
+int trace_relative      = 0;        /* valuators reporting motion */
+int trace_minimum[TRACE_VALUATORS]; /* lowest value each may report */
+TraceEvent trace_state;             /* the latest value of each */
+
+/* Atoms interned once per connection, see dp_intern_atoms() */
+Atom* param_atoms       = NULL;     /* params[j].prop_name -> param_atoms[j] */
+Atom float_atom         = None;
+Atom touchpad_atom      = None;
+
+static int
+dp_params_count()
+{
+    int n = 0;
+    while (params[n].name)
+        n++;
+    return n;
+}
+
+/*
+ * Interns the property atom of every params[] entry together with FLOAT
+ * and XI_TOUCHPAD in a single XInternAtoms() call. Duplicated property
+ * names are sent only once. Atoms of properties the server does not know
+ * are left as None.
+ */
+static void
+dp_intern_atoms(Display *dpy)
+{
+    int nparams = dp_params_count();
+    int* slot   = new int[nparams];
+    char** names = new char*[nparams + 2];
+    Atom* atoms = new Atom[nparams + 2];
+    int natoms  = 0;
+
+    int j, k;
+    for (j = 0; j < nparams; j++) {
+        for (k = 0; k < natoms; k++)
+            if (!strcmp(names[k], params[j].prop_name))
+                break;
+        if (k == natoms)
+            names[natoms++] = (char*)params[j].prop_name;
+        slot[j] = k;
+    }
+    names[natoms] = (char*)XATOM_FLOAT;
+    names[natoms + 1] = (char*)XI_TOUCHPAD;
+
+    /* Only-if-exists: returns zero when some atom is unknown, which is fine */
+    if (dpy) {
+        double start = xstats_start();
+        XInternAtoms(dpy, names, natoms + 2, True, atoms);
+        for (j = 0; j < natoms + 2; j++)
+            xstats_request(1, 8 + xstats_pad(strlen(names[j])));
+        /* Xlib waits for the last reply only */
+        xstats_reply(start, 32 * (natoms + 2));
+    }
+    else
+        fake_intern_atoms(names, natoms + 2, atoms);
+
+    delete[] param_atoms;
+    param_atoms = new Atom[nparams];
+    for (j = 0; j < nparams; j++)
+        param_atoms[j] = atoms[slot[j]];
+    float_atom = atoms[natoms];
+    touchpad_atom = atoms[natoms + 1];
+
+    delete[] atoms;
+    delete[] names;
+    delete[] slot;
+}
+
+static Atom
+dp_property_atom(const char *prop_name)
+{
+    int j;
+    for (j = 0; params[j].name; j++)
+        if (!strcmp(params[j].prop_name, prop_name))
+            return param_atoms[j];
+    return None;
+}
+
+/*
+ * KCM_TOUCHPAD_BACKEND=fake replaces the X server by an in-memory device,
+ * see touchpad_fake.cpp.
+ */
+static bool
+dp_fake_requested()
+{
+    const char* requested = getenv("KCM_TOUCHPAD_BACKEND");
+    return requested && !strcmp(requested, "fake");
+}
+
+/*
+ * Picks the property I/O implementation. The pipelining xcb one is used
+ * when available unless KCM_TOUCHPAD_BACKEND=xlib is set.
+ */
+static PropertyBackend*
+dp_create_backend(Display *dpy, XDevice *dev)
+{
+    const char* requested = getenv("KCM_TOUCHPAD_BACKEND");
+
+#ifdef HAVE_XCB_XINPUT
+    if (!requested || strcmp(requested, "xlib"))
+        return create_xcb_backend(dpy, dev);
+#else
+    if (requested && !strcmp(requested, "xcb"))
+        fprintf(stderr, "Built without xcb-xinput, using Xlib.\n");
+#endif
+
+    return create_xlib_backend(dpy, dev);
+}
 
 static Display*
 dp_init()
 {
     XExtensionVersion *v	= NULL;
-    Atom touchpad_type		= 0;
-    Atom synaptics_property	= 0;
     int error			= 0;
 
+    double start = xstats_start();
     Display* dpy = XOpenDisplay(NULL);
+    /* connection setup, the reply size depends on the server */
+    xstats_request(1, 12);
+    xstats_reply(start, 0);
     if (!dpy) {
         fprintf(stderr, "Failed to connect to X Server.\n");
         error = 1;
         goto unwind;
     }
 
+    start = xstats_start();
     v = XGetExtensionVersion(dpy, INAME);
+    xstats_request(1, 8 + xstats_pad(strlen(INAME)));
+    xstats_reply(start, 32);
     if (!v->present ||
         (v->major_version * 1000 + v->minor_version) < (XI_Add_DeviceProperties_Major * 1000
             + XI_Add_DeviceProperties_Minor)) {
@@ -82,16 +310,16 @@ dp_init()
         goto unwind;
     }
 
+    dp_intern_atoms(dpy);
+
     /* We know synaptics sets XI_TOUCHPAD for all the devices. */
-    touchpad_type = XInternAtom(dpy, XI_TOUCHPAD, True);
-    if (!touchpad_type) {
+    if (!touchpad_atom) {
         fprintf(stderr, "XI_TOUCHPAD not initialised.\n");
         error = 1;
         goto unwind;
     }
 
-    synaptics_property = XInternAtom(dpy, SYNAPTICS_PROP_EDGES, True);
-    if (!synaptics_property) {
+    if (!dp_property_atom(SYNAPTICS_PROP_EDGES)) {
         fprintf(stderr, "Couldn't find synaptics properties. No synaptics "
                 "driver loaded?\n");
         error = 1;
@@ -108,306 +336,1256 @@ unwind:
     return dpy;
 }
 
-static XDevice *
-dp_get_device(Display *dpy)
+static void dp_mirror_properties(Display *dpy, TouchpadDevice *td,
+                                 const Atom *listed, int nlisted);
+static void dp_stop_trace(Display *dpy);
+
+/*
+ * Opens the device and checks it is driven by synaptics.
+ */
+static TouchpadDevice *
+dp_open_device(Display *dpy, XID id, const char *name)
 {
-    XDevice* dev                = NULL;
-    XDeviceInfo *info		= NULL;
-    int ndevices		= 0;
-    Atom touchpad_type		= 0;
-    Atom synaptics_property	= 0;
+    Atom synaptics_property	= dp_property_atom(SYNAPTICS_PROP_EDGES);
     Atom *properties		= NULL;
     int nprops			= 0;
-    int error			= 0;
 
-    touchpad_type = XInternAtom(dpy, XI_TOUCHPAD, True);
-    synaptics_property = XInternAtom(dpy, SYNAPTICS_PROP_EDGES, True);
-    info = XListInputDevices(dpy, &ndevices);
+    double start = xstats_start();
+    XDevice* dev = XOpenDevice(dpy, id);
+    xstats_request(1, 8);
+    xstats_reply(start, 32 + (dev ? xstats_pad(dev->num_classes * 2) : 0));
+    if (!dev) {
+        fprintf(stderr, "Failed to open device '%s'.\n", name);
+        return NULL;
+    }
 
-    while(ndevices--) {
-        if (info[ndevices].type == touchpad_type) {
-            dev = XOpenDevice(dpy, info[ndevices].id);
-            if (!dev) {
-                fprintf(stderr, "Failed to open device '%s'.\n",
-                        info[ndevices].name);
-                error = 1;
-                goto unwind;
-            }
+    start = xstats_start();
+    properties = XListDeviceProperties(dpy, dev, &nprops);
+    xstats_request(1, 8);
+    xstats_reply(start, 32 + 4 * nprops);
+    if (!properties || !nprops)
+    {
+        fprintf(stderr, "No properties on device '%s'.\n", name);
+        XFree(properties);
+        xstats_request(1, 8);
+        XCloseDevice(dpy, dev);
+        return NULL;
+    }
 
-            properties = XListDeviceProperties(dpy, dev, &nprops);
-            if (!properties || !nprops)
-            {
-                fprintf(stderr, "No properties on device '%s'.\n",
-                        info[ndevices].name);
-                error = 1;
-                goto unwind;
-            }
+    bool synaptics = std::find(properties, properties + nprops, synaptics_property)
+                        != properties + nprops;
+    if (!synaptics)
+    {
+        fprintf(stderr, "No synaptics properties on device '%s'.\n", name);
+        XFree(properties);
+        xstats_request(1, 8);
+        XCloseDevice(dpy, dev);
+        return NULL;
+    }
 
-            while(nprops--)
-            {
-                if (properties[nprops] == synaptics_property)
-                    break;
-            }
-            if (!nprops)
-            {
-                fprintf(stderr, "No synaptics properties on device '%s'.\n",
-                        info[ndevices].name);
-                error = 1;
-                goto unwind;
-            }
+    TouchpadDevice* td = new TouchpadDevice;
+    td->device = dev;
+    td->name = strdup(name);
+    td->backend = dp_create_backend(dpy, dev);
+    fprintf(stderr, "Recognized device: %s\n", td->name);
 
-            dev_name = strdup(info[ndevices].name);
-            printf("Recognized device: %s\n", dev_name);
+    /* only what the device has, the list says what that is */
+    dp_mirror_properties(dpy, td, properties, nprops);
+    XFree(properties);
+
+    return td;
+}
+
+/*
+ * Sets up the fake device in place of the synaptics devices of a server.
+ */
+static TouchpadDevice *
+dp_open_fake_device()
+{
+    TouchpadDevice* td = new TouchpadDevice;
+    td->device = new XDevice;
+    memset(td->device, 0, sizeof(XDevice));
+    td->device->device_id = 2;
+    td->name = strdup(fake_device_name());
+    td->backend = create_fake_backend();
+
+    dp_mirror_properties(NULL, td, NULL, 0);
+
+    return td;
+}
+
+/*
+ * gone: the server removed the device already, closing it there would
+ * only earn a BadDevice error, fatal with the default error handler.
+ */
+static void
+dp_close_device(Display *dpy, TouchpadDevice *td, bool gone)
+{
+    delete td->backend;
+    if (!dpy)
+        delete td->device;  /* fake */
+    else if (gone)
+        XFree(td->device);  /* XOpenDevice allocates it in one block */
+    else {
+        xstats_request(1, 8);
+        XCloseDevice(dpy, td->device);
+    }
+    free(td->name);
+    delete td;
+}
 
-            break; /* Yay, device is suitable */
+/*
+ * Lists the distinct properties the open devices have, for
+ * Touchpad::get_properties_list().
+ */
+static void
+dp_index_properties()
+{
+    param_set present;
+    for (touchpad_devices::const_iterator it = devices.begin(); it != devices.end(); ++it)
+        present |= it->second->present;
+
+    properties_list.clear();
+    for (int j = 0; params[j].name; j++) {
+        if (!present[j])
+            continue;
+        /* parameters of one property share its atom */
+        int k;
+        for (k = 0; k < j; k++)
+            if (present[k] && param_atoms[k] == param_atoms[j])
+                break;
+        if (k == j)
+            properties_list.push_back(params[j].prop_name);
+    }
+}
+
+static void
+dp_add_device(TouchpadDevice *td)
+{
+    devices[td->device->device_id] = td;
+    device_ids.push_back(td->device->device_id);
+    if (!current)
+        current = td;
+    dp_index_properties();
+}
+
+static void
+dp_remove_device(Display *dpy, int id, bool gone)
+{
+    touchpad_devices::iterator it = devices.find(id);
+    if (it == devices.end())
+        return;
+
+    /* the server may have forgotten the device already */
+    if (id == trace_device)
+        dp_stop_trace(NULL);
+
+    TouchpadDevice* td = it->second;
+    devices.erase(it);
+    device_ids.remove(id);
+    if (current == td)
+        current = devices.empty() ? NULL : devices.begin()->second;
+
+    dp_close_device(dpy, td, gone);
+    dp_index_properties();
+}
+
+/*
+ * Opens every synaptics device. Returns the number of devices found.
+ */
+static int
+dp_get_devices(Display *dpy)
+{
+    XDeviceInfo *info		= NULL;
+    int ndevices		= 0;
+
+    double start = xstats_start();
+    info = XListInputDevices(dpy, &ndevices);
+    xstats_request(1, 4);
+    if (xstats_enabled()) {
+        /* device and name records; class records are left out */
+        unsigned long bytes = 0;
+        for (int j = 0; j < ndevices; j++)
+            bytes += 8 + 1 + strlen(info[j].name);
+        xstats_reply(start, 32 + xstats_pad(bytes));
+    }
+
+    /* walk backwards so the last one, as before, becomes the current one */
+    while(ndevices--) {
+        if (info[ndevices].type == touchpad_atom) {
+            TouchpadDevice* td = dp_open_device(dpy, info[ndevices].id, info[ndevices].name);
+            if (td)
+                dp_add_device(td);
         }
     }
 
-unwind:
-    XFree(properties);
     XFreeDeviceList(info);
-    if (!dev)
+    if (devices.empty())
         fprintf(stderr, "Unable to find a synaptics device.\n");
-    else if (error && dev)
-    {
-        XCloseDevice(dpy, dev);
-        dev = NULL;
+
+    return devices.size();
+}
+
+/*
+ * Asks for XI2 hierarchy events, so devices plugged in or enabled later
+ * are noticed without rescanning the device list.
+ */
+static void
+dp_watch_hierarchy(Display *dpy)
+{
+    int event, error, major = 2, minor = 0;
+
+    double start = xstats_start();
+    bool present = XQueryExtension(dpy, INAME, &xi_opcode, &event, &error);
+    xstats_request(1, 8 + xstats_pad(strlen(INAME)));
+    xstats_reply(start, 32);
+    if (!present) {
+        xi_opcode = -1;
+        return;
     }
-    return dev;
+
+    start = xstats_start();
+    Status status = XIQueryVersion(dpy, &major, &minor);
+    xstats_request(1, 8);
+    xstats_reply(start, 32);
+    if (status != Success) {
+        xi_opcode = -1;
+        return;
+    }
+
+    unsigned char mask[XIMaskLen(XI_HierarchyChanged)] = { 0 };
+    XIEventMask evmask;
+    evmask.deviceid = XIAllDevices;
+    evmask.mask_len = sizeof(mask);
+    evmask.mask = mask;
+    XISetMask(mask, XI_HierarchyChanged);
+    xstats_request(1, 12 + 4 + xstats_pad(sizeof(mask)));
+    XISelectEvents(dpy, DefaultRootWindow(dpy), &evmask, 1);
 }
 
-static void*
-dp_get_parameter(Display *dpy, XDevice *dev, const char *name) {
-    Atom a, type, float_type;
-    int format;
-    unsigned long nitems, bytes_after;
-    unsigned char* data;
-    int len;
+/*
+ * Whether a device has the synaptics properties, asked without opening it,
+ * so mice and trackpoints plugged in are passed over without a word.
+ */
+static bool
+dp_has_synaptics_properties(Display *dpy, int deviceid)
+{
+    Atom synaptics_property = dp_property_atom(SYNAPTICS_PROP_EDGES);
+    int nprops = 0;
 
-    union flong *f;
-    long *i;
-    char *b;
+    if (!synaptics_property)
+        return false;
 
-    float_type = XInternAtom(dpy, XATOM_FLOAT, True);
-    if (!float_type)
-        fprintf(stderr, "Float properties not available.\n");
+    double start = xstats_start();
+    Atom* properties = XIListProperties(dpy, deviceid, &nprops);
+    xstats_request(1, 8);
+    xstats_reply(start, 32 + 4 * nprops);
+    if (!properties)
+        return false;
 
-    struct Parameter *par = (*parameters_map)[name];
-    a = XInternAtom(dpy, par->prop_name, True);
-    if (!a) {
-        fprintf(stderr, "    %-23s = missing\n", par->name);
-        return NULL;
-    }
+    bool synaptics = std::find(properties, properties + nprops, synaptics_property)
+                        != properties + nprops;
+    XFree(properties);
+    return synaptics;
+}
 
-    len = 1 + ((par->prop_offset * (par->prop_format ? par->prop_format : 32)/8))/4;
+/*
+ * Handles a hierarchy change: newly enabled synaptics devices are opened
+ * (only the one device is queried), disabled or removed ones are closed.
+ */
+static void
+dp_hierarchy_changed(Display *dpy, XIHierarchyEvent *hev,
+                     device_list *added, device_list *removed)
+{
+    for (int i = 0; i < hev->num_info; i++) {
+        XIHierarchyInfo* info = &hev->info[i];
 
-    XGetDeviceProperty(dpy, dev, a, 0, len, False,
-                            AnyPropertyType, &type, &format,
-                            &nitems, &bytes_after, &data);
+        if (info->flags & (XISlaveRemoved | XIDeviceDisabled)) {
+            if (devices.count(info->deviceid)) {
+                dp_remove_device(dpy, info->deviceid, info->flags & XISlaveRemoved);
+                if (removed)
+                    removed->push_back(info->deviceid);
+            }
+        }
+        else if (info->flags & XIDeviceEnabled &&
+                 info->use == XISlavePointer && !devices.count(info->deviceid) &&
+                 dp_has_synaptics_properties(dpy, info->deviceid)) {
+            int ndevices = 0;
+            double start = xstats_start();
+            XIDeviceInfo* dinfo = XIQueryDevice(dpy, info->deviceid, &ndevices);
+            xstats_request(1, 8);
+            /* class records are left out */
+            xstats_reply(start, 32 + (dinfo ? 12 + xstats_pad(strlen(dinfo->name)) : 0));
+            if (!dinfo)
+                continue;
+
+            TouchpadDevice* td = dp_open_device(dpy, info->deviceid, dinfo->name);
+            XIFreeDeviceInfo(dinfo);
+            if (td) {
+                dp_add_device(td);
+                if (added)
+                    added->push_back(info->deviceid);
+            }
+        }
+    }
+}
+
+/*
+ * Extracts the value of a parameter from an already fetched property.
+ */
+static bool
+dp_decode_parameter(const struct Parameter *par, const PropertyData& prop, double *value)
+{
+    if ((size_t)par->prop_offset >= prop.items.size()) {
+        fprintf(stderr, "   %-23s = missing\n", par->name);
+        return false;
+    }
 
     switch(par->prop_format) {
         case 8:
+        case 32:
+            if (prop.format != par->prop_format || prop.type != XA_INTEGER)
+                break;
+            *value = prop.items[par->prop_offset];
+            return true;
+        case 0: /* Float */
         {
-            if (format != par->prop_format || type != XA_INTEGER) {
-                fprintf(stderr, "   %-23s = format mismatch (%d)\n",
-                        par->name, format);
+            if (prop.format != 32 || prop.type != float_atom)
                 break;
-            }
+            union flong f;
+            f.l = prop.items[par->prop_offset];
+            *value = f.f;
+            return true;
+        }
+    }
 
-            b = (char*)data;
-            char* b_value = new char;
-            *b_value = b[par->prop_offset];
-            return b_value;
-            break;
+    fprintf(stderr, "   %-23s = format mismatch (%d)\n", par->name, prop.format);
+    return false;
+}
+
+/*
+ * Reads a single parameter from the mirror, which makes it free of
+ * requests and allocations.
+ */
+static bool
+dp_get_value(TouchpadDevice *td, ParamId id, double *value)
+{
+    /* the mirror holds every property the device has */
+    if (!td->present[id])
+        return false;
+    return dp_decode_parameter(&params[id], td->mirror[param_atoms[id]], value);
+}
+
+/*
+ * Reads all requested parameters from the mirror. Parameters which could
+ * not be read are removed from the map.
+ */
+static int
+dp_get_parameters(TouchpadDevice *td, param_values& values)
+{
+    int count = 0;
+
+    for (param_values::iterator it = values.begin(); it != values.end(); ) {
+        param_hash::const_iterator p = parameters_map->find(it->first);
+        double value;
+        if (p == parameters_map->end() ||
+            !dp_get_value(td, (ParamId)(p->second - params), &value)) {
+            values.erase(it++);
+            continue;
         }
-        case 32:
-        {
-            if (format != par->prop_format || type != XA_INTEGER) {
-                fprintf(stderr, "   %-23s = format mismatch (%d)\n",
-                        par->name, format);
-                break;
-            }
+        it->second = value;
+        count++;
+        ++it;
+    }
+
+    return count;
+}
+
+/*
+ * Notes which parameters the mirror holds and which capabilities the
+ * device reports it lacks, so neither needs a lookup later.
+ */
+static void
+dp_index_device(TouchpadDevice *td)
+{
+    Atom capabilities = dp_property_atom(SYNAPTICS_PROP_CAPABILITIES);
+
+    td->present.reset();
+    td->lacking.reset();
+    for (int j = 0; params[j].name; j++) {
+        if (!param_atoms[j])
+            continue;
+        property_mirror::const_iterator m = td->mirror.find(param_atoms[j]);
+        if (m == td->mirror.end() || (size_t)params[j].prop_offset >= m->second.items.size())
+            continue;
+        td->present.set(j);
+        if (param_atoms[j] == capabilities && !m->second.items[params[j].prop_offset])
+            td->lacking.set(j);
+    }
+}
+
+/*
+ * Fetches every synaptics property of the device into the mirror and asks
+ * the server for DevicePropertyNotify events, so later reads are answered
+ * locally and changes made by other clients are noticed. listed holds the
+ * properties of the device as XListDeviceProperties() returned them; the
+ * others are not asked for. NULL asks for all.
+ */
+static void
+dp_mirror_properties(Display *dpy, TouchpadDevice *td, const Atom *listed, int nlisted)
+{
+    std::vector<Atom> atoms;
+    std::vector<PropertyData> props;
+
+    for (int j = 0; params[j].name; j++) {
+        if (!param_atoms[j] || std::find(atoms.begin(), atoms.end(), param_atoms[j]) != atoms.end())
+            continue;
+        if (listed && std::find(listed, listed + nlisted, param_atoms[j]) == listed + nlisted)
+            continue;
+        atoms.push_back(param_atoms[j]);
+    }
+
+    if (!atoms.empty())
+        td->backend->get_properties(atoms, std::vector<long>(atoms.size(), 1000), props);
+
+    td->mirror.clear();
+    for (size_t j = 0; j < atoms.size(); j++)
+        if (props[j].type != None)
+            td->mirror[atoms[j]] = props[j];
+    dp_index_device(td);
+
+    if (!dpy)
+        return;     /* fake, nobody else changes it */
+
+    XEventClass event_class;
+    DevicePropertyNotify(td->device, property_event_type, event_class);
+    xstats_request(1, 12 + 4);
+    if (XSelectExtensionEvent(dpy, DefaultRootWindow(dpy), &event_class, 1))
+        property_event_type = -1;
+}
 
-            i = (long*)data;
-            int* i_value = new int;
-            *i_value = i[par->prop_offset];
-            return i_value;
+/*
+ * Finds the valuators of position, pressure and finger width by their
+ * labels, preferring absolute axes. Returns a mask of those found.
+ */
+static int
+dp_trace_axes(Display *dpy, int id)
+{
+    static const char* labels[] = {
+        "Abs X", "Rel X", "Abs Y", "Rel Y", "Abs Pressure", "Abs Tool Width"
+    };
+    static const int label_axes[] = {
+        TRACE_X, TRACE_X, TRACE_Y, TRACE_Y, TRACE_PRESSURE, TRACE_WIDTH
+    };
+    const int nlabels = sizeof(labels) / sizeof(labels[0]);
+    Atom atoms[nlabels];
+    int found = 0;
+
+    trace_relative = 0;
+    for (int v = 0; v < TRACE_VALUATORS; v++) {
+        trace_axes[v] = -1;
+        trace_minimum[v] = 0;
+    }
+
+    double start = xstats_start();
+    XInternAtoms(dpy, (char**)labels, nlabels, True, atoms);
+    for (int j = 0; j < nlabels; j++)
+        xstats_request(1, 8 + xstats_pad(strlen(labels[j])));
+    xstats_reply(start, 32 * nlabels);
+
+    int ndevices;
+    start = xstats_start();
+    XIDeviceInfo *info = XIQueryDevice(dpy, id, &ndevices);
+    xstats_request(1, 8);
+    xstats_reply(start, 32 + (info ? 44 * info->num_classes : 0));
+    if (!info)
+        return 0;
+
+    for (int j = 0; j < nlabels; j++) {
+        int axis = label_axes[j];
+        if (!atoms[j] || trace_axes[axis] != -1)
+            continue;
+
+        for (int c = 0; c < info->num_classes; c++) {
+            XIValuatorClassInfo *val = (XIValuatorClassInfo*)info->classes[c];
+            if (val->type != XIValuatorClass || val->label != atoms[j])
+                continue;
+            trace_axes[axis] = val->number;
+            if (labels[j][0] == 'R')
+                trace_relative |= 1 << axis;
+            else
+                trace_minimum[axis] = (int)floor(val->min);
+            found |= 1 << axis;
             break;
         }
-        case 0: /* Float */
-        {
-            if (format != 32 || type != float_type) {
-                fprintf(stderr, "   %-23s = format mismatch (%d)\n",
-                        par->name, format);
-                break;
+    }
+
+    XIFreeDeviceInfo(info);
+    return found;
+}
+
+static void
+dp_select_raw_events(Display *dpy, int id, bool enable)
+{
+    unsigned char mask[XIMaskLen(XI_RawMotion)] = { 0 };
+    XIEventMask evmask;
+    evmask.deviceid = id;
+    evmask.mask_len = sizeof(mask);
+    evmask.mask = mask;
+    if (enable) {
+        XISetMask(mask, XI_RawButtonPress);
+        XISetMask(mask, XI_RawButtonRelease);
+        XISetMask(mask, XI_RawMotion);
+    }
+    xstats_request(1, 12 + 4 + xstats_pad(sizeof(mask)));
+    XISelectEvents(dpy, DefaultRootWindow(dpy), &evmask, 1);
+    XFlush(dpy);
+}
+
+/*
+ * Queues a raw event of the traced device. Valuators not in the event keep
+ * their last value, relative ones are 0.
+ */
+static void
+dp_trace_raw_event(XIRawEvent *raw)
+{
+    if (raw->deviceid != trace_device)
+        return;
+
+    TraceEvent& ev = trace_state;
+    ev.time = raw->time;
+    if (raw->evtype == XI_RawMotion)
+        ev.type = TRACE_MOTION;
+    else if (raw->evtype == XI_RawButtonPress)
+        ev.type = TRACE_BUTTON_PRESS;
+    else
+        ev.type = TRACE_BUTTON_RELEASE;
+    ev.button = ev.type == TRACE_MOTION ? 0 : raw->detail;
+
+    for (int v = 0; v < TRACE_VALUATORS; v++)
+        if (trace_relative & (1 << v))
+            ev.values[v] = 0;
+
+    /* values are packed, one per bit set in the mask */
+    double *value = raw->raw_values;
+    for (int n = 0; n < raw->valuators.mask_len * 8; n++) {
+        if (!XIMaskIsSet(raw->valuators.mask, n))
+            continue;
+        for (int v = 0; v < TRACE_VALUATORS; v++)
+            if (trace_axes[v] == n)
+                ev.values[v] = (int)floor(*value + 0.5);
+        value++;
+    }
+
+    trace_ring->push(ev);
+}
+
+/*
+ * Ends tracing; dpy is NULL when the device is gone and cannot be
+ * deselected.
+ */
+static void
+dp_stop_trace(Display *dpy)
+{
+    if (!trace_ring)
+        return;
+
+    if (dpy)
+        dp_select_raw_events(dpy, trace_device, false);
+    Touchpad::flush_trace();
+
+    delete trace_writer;
+    delete trace_ring;
+    trace_writer = NULL;
+    trace_ring = NULL;
+    trace_device = -1;
+}
+
+/*
+ * Drains pending events. Mirrored properties the server reported as changed
+ * are refreshed with a single batch per device and their names are appended
+ * to changed, for the current device only, or to all, per device. Hierarchy
+ * events open and close devices. reindex is set when a device gained or
+ * lost parameters.
+ */
+static int
+dp_drain_events(Display *dpy, prop_list *changed, device_changes *all,
+                device_list *added, device_list *removed, bool& reindex)
+{
+    std::map<int, std::vector<Atom> > notified;
+
+    while (XPending(dpy)) {
+        XEvent ev;
+        XNextEvent(dpy, &ev);
+
+        if (ev.type == GenericEvent && ev.xcookie.extension == xi_opcode) {
+            if (XGetEventData(dpy, &ev.xcookie)) {
+                if (ev.xcookie.evtype == XI_HierarchyChanged)
+                    dp_hierarchy_changed(dpy, (XIHierarchyEvent*)ev.xcookie.data,
+                                         added, removed);
+                else if (ev.xcookie.evtype == XI_RawKeyPress)
+                    key_presses++;
+                else if (ev.xcookie.evtype == XI_RawMotion ||
+                         ev.xcookie.evtype == XI_RawButtonPress ||
+                         ev.xcookie.evtype == XI_RawButtonRelease)
+                    dp_trace_raw_event((XIRawEvent*)ev.xcookie.data);
+                XFreeEventData(dpy, &ev.xcookie);
             }
+            continue;
+        }
 
-            f = (union flong*)data;
-            double* d_value = new double;
-            *d_value = f[par->prop_offset].f;
-            return d_value;
-            break;
+        if (ev.type != property_event_type)
+            continue;
+
+        XDevicePropertyNotifyEvent* pev = (XDevicePropertyNotifyEvent*)&ev;
+        touchpad_devices::iterator d = devices.find(pev->deviceid);
+        if (d == devices.end())
+            continue;
+
+        std::vector<Atom>& atoms = notified[pev->deviceid];
+        if (pev->state == PropertyDelete)
+            d->second->mirror.erase(pev->atom);
+        else if (std::find(atoms.begin(), atoms.end(), pev->atom) == atoms.end())
+            atoms.push_back(pev->atom);
+    }
+
+    int count = 0;
+    for (std::map<int, std::vector<Atom> >::const_iterator n = notified.begin();
+         n != notified.end(); ++n) {
+        touchpad_devices::iterator d = devices.find(n->first);
+        const std::vector<Atom>& atoms = n->second;
+        std::vector<PropertyData> props;
+
+        /* the device may have gone away meanwhile */
+        if (d == devices.end())
+            continue;
+
+        TouchpadDevice* td = d->second;
+        param_set present = td->present;
+        if (atoms.empty()) {
+            /* deletions only */
+            dp_index_device(td);
+            reindex |= td->present != present;
+            continue;
         }
+        td->backend->get_properties(atoms, std::vector<long>(atoms.size(), 1000), props);
+
+        for (size_t j = 0; j < atoms.size(); j++) {
+            int k;
+            for (k = 0; params[k].name; k++)
+                if (param_atoms[k] == atoms[j])
+                    break;
+            if (!params[k].name)
+                continue;       /* not a property we know */
+
+            if (props[j].type != None)
+                td->mirror[atoms[j]] = props[j];
+            else
+                td->mirror.erase(atoms[j]);
+            if (all) {
+                (*all)[n->first].push_back(params[k].prop_name);
+                count++;
+            } else if (td == current) {
+                changed->push_back(params[k].prop_name);
+                count++;
+            }
+        }
+        dp_index_device(td);
+        reindex |= td->present != present;
     }
 
-    XFree(data);
-    return 0;
+    return count;
+}
+
+/*
+ * Runs dp_drain_events() until no event is left. Events arriving while the
+ * property fetches or the hierarchy handling wait for their replies land in
+ * the queue of Xlib, where the caller's watch on the connection never sees
+ * them, so they have to be picked up here.
+ */
+static int
+dp_process_events(Display *dpy, prop_list *changed, device_changes *all,
+                  device_list *added, device_list *removed)
+{
+    int count = 0;
+    bool reindex = false;
+
+    do
+        count += dp_drain_events(dpy, changed, all, added, removed, reindex);
+    while (XPending(dpy));
+
+    if (reindex)
+        dp_index_properties();
+
+    /* nobody flushed the trace for long, write it out rather than drop */
+    if (trace_writer && trace_ring->size() > trace_ring->capacity() / 4 * 3)
+        Touchpad::flush_trace();
+
+    return count;
 }
 
 static param_hash*
-dp_prepare_parameters_hash(Display *dpy) {
+dp_prepare_parameters_hash() {
     param_hash* parameters_hash = new param_hash;
 
     int j;
     for (j = 0; params[j].name; j++) {
-        if (XInternAtom(dpy, params[j].prop_name, True))
+        if (param_atoms[j])
             (*parameters_hash)[params[j].name] = &params[j];
     }
 
     return parameters_hash;
 }
 
-static prop_list*
-dp_prepare_properties_list(Display *dpy) {
-    prop_list* properties_list = new prop_list;
+/*
+ * Stores the value of a parameter into an already fetched property.
+ */
+static bool
+dp_encode_parameter(const struct Parameter *par, PropertyData& prop, double value)
+{
+    if ((size_t)par->prop_offset >= prop.items.size()) {
+        fprintf(stderr, "   %-23s = missing\n", par->name);
+        return false;
+    }
 
-    int j;
-    for (j = 0; params[j].prop_name; j++) {
-        if (XInternAtom(dpy, params[j].prop_name, True))
-            properties_list->push_back(params[j].prop_name);
-        else
-            fprintf(stderr, "Property for '%s' not available. Skipping.\n", params[j].prop_name);
+    switch(par->prop_format) {
+        case 8:
+        case 32:
+            if (prop.format != par->prop_format || prop.type != XA_INTEGER)
+                break;
+            prop.items[par->prop_offset] = rint(value);
+            return true;
+        case 0: /* float */
+        {
+            if (prop.format != 32 || prop.type != float_atom)
+                break;
+            union flong f;
+            f.l = prop.items[par->prop_offset];
+            f.f = value;
+            prop.items[par->prop_offset] = f.l;
+            return true;
+        }
     }
 
-    return properties_list;
+    fprintf(stderr, "   %-23s = format mismatch (%d)\n", par->name, prop.format);
+    return false;
 }
 
-static void
-dp_set_parameter(Display *dpy, XDevice* dev, const char* name, double var)
+/*
+ * Writes all given parameters with a single read-modify-write per property.
+ * Since every slot of a property changes at once the driver validates only
+ * the final state, so interdependent values (e.g. FingerLow < FingerHigh)
+ * need no particular order. Returns the number of properties changed;
+ * written, if given, receives the parameters which were sent.
+ */
+static int
+dp_set_parameters(TouchpadDevice *td, const param_values& values, param_values *written = NULL)
 {
-    Atom prop, type, float_type;
-    int format;
-    unsigned char* data;
-    unsigned long nitems, bytes_after;
-
-    union flong *f;
-    long *n;
-    char *b;
+    typedef std::map<Atom, std::list<std::pair<const struct Parameter*, double> > > prop_params;
+    prop_params grouped;
 
-    float_type = XInternAtom(dpy, XATOM_FLOAT, True);
-    if (!float_type)
+    if (!float_atom)
         fprintf(stderr, "Float properties not available.\n");
 
-    struct Parameter *par = (*parameters_map)[name];
-    prop = XInternAtom(dpy, par->prop_name, True);
-    if (!prop) {
-        fprintf(stderr, "Property for '%s' not available. Skipping.\n", par->name);
+    for (param_values::const_iterator it = values.begin(); it != values.end(); ++it) {
+        param_hash::const_iterator p = parameters_map->find(it->first);
+        if (p == parameters_map->end() || !td->present[p->second - params]) {
+            fprintf(stderr, "Property for '%s' not available. Skipping.\n", it->first);
+            continue;
+        }
+        grouped[param_atoms[p->second - params]].push_back(std::make_pair(p->second, it->second));
     }
 
-    XGetDeviceProperty(dpy, dev, prop, 0, 1000, False, AnyPropertyType,
-                            &type, &format, &nitems, &bytes_after, &data);
+    std::vector<Atom> changed_atoms;
+    std::vector<PropertyData> changed;
+    prop_params::const_iterator g;
+    size_t j;
+    /* the mirror holds whole properties, nothing needs fetching */
+    for (g = grouped.begin(); g != grouped.end(); ++g) {
+        PropertyData prop = td->mirror[g->first];
+        bool modified = false;
 
-    switch(par->prop_format)
-    {
-        case 8:
-            if (format != par->prop_format || type != XA_INTEGER) {
-                fprintf(stderr, "   %-23s = format mismatch (%d)\n",
-                        par->name, format);
-                break;
-            }
-            b = (char*)data;
-            b[par->prop_offset] = rint(var);
-            break;
-        case 32:
-            if (format != par->prop_format || type != XA_INTEGER) {
-                fprintf(stderr, "   %-23s = format mismatch (%d)\n",
-                        par->name, format);
-                break;
-            }
-            n = (long*)data;
-            n[par->prop_offset] = rint(var);
-            break;
-        case 0: /* float */
-            if (format != 32 || type != float_type) {
-                fprintf(stderr, "   %-23s = format mismatch (%d)\n",
-                        par->name, format);
-                break;
-            }
-            f = (union flong*)data;
-            f[par->prop_offset].f = var;
-            break;
+        std::list<std::pair<const struct Parameter*, double> >::const_iterator par;
+        for (par = g->second.begin(); par != g->second.end(); ++par) {
+            if (!dp_encode_parameter(par->first, prop, par->second))
+                continue;
+            modified = true;
+            if (written)
+                (*written)[par->first->name] = par->second;
+        }
+
+        if (modified) {
+            changed_atoms.push_back(g->first);
+            changed.push_back(prop);
+        }
     }
 
-    XChangeDeviceProperty(dpy, dev, prop, type, format,
-                            PropModeReplace, data, nitems);
-    XFlush(dpy);
+    if (!changed.empty())
+        td->backend->change_properties(changed_atoms, changed);
+
+    /* keep the mirror coherent until the property notify arrives */
+    for (j = 0; j < changed.size(); j++)
+        td->mirror[changed_atoms[j]] = changed[j];
+
+    return changed.size();
 }
 
 
 int
 Touchpad::init_xinput_extension() {
+    XStatsScope scope("init_xinput_extension");
+    if (dp_fake_requested()) {
+        dp_intern_atoms(NULL);
+        parameters_map = dp_prepare_parameters_hash();
+        dp_add_device(dp_open_fake_device());
+        return 0;
+    }
+
     display = dp_init();
     if (display == NULL)
         return GET_DISPLAY_FAILED;
 
-    device = dp_get_device(display);
-    if (device == NULL)
-        return GET_DEVICE_FAILED;
+    parameters_map = dp_prepare_parameters_hash();
 
-    parameters_map = dp_prepare_parameters_hash(display);
-    properties_list = dp_prepare_properties_list(display);
+    dp_watch_hierarchy(display);
+    if (!dp_get_devices(display))
+        return GET_DEVICE_FAILED;
 
     return 0;
 }
 
 const prop_list*
 Touchpad::get_properties_list() {
-    return properties_list;
+    return parameters_map ? &properties_list : NULL;
 }
 
-const void*
-Touchpad::get_parameter(const char* name) {
-    if (display && device)
-        return dp_get_parameter(display, device, name);
-    return NULL;
+const device_list&
+Touchpad::get_devices() {
+    return device_ids;
+}
+
+bool
+Touchpad::select_device(int id) {
+    touchpad_devices::const_iterator it = devices.find(id);
+    if (it == devices.end())
+        return false;
+
+    current = it->second;
+    return true;
+}
+
+int
+Touchpad::get_current_device() {
+    return current ? current->device->device_id : -1;
+}
+
+bool
+Touchpad::get_parameter(ParamId id, double& value) {
+    XStatsScope scope("get_parameter");
+    return current && dp_get_value(current, id, &value);
+}
+
+int
+Touchpad::get_int(ParamId id, int fallback) {
+    double value;
+    return get_parameter(id, value) ? (int)value : fallback;
+}
+
+bool
+Touchpad::get_bool(ParamId id, bool fallback) {
+    double value;
+    return get_parameter(id, value) ? value != 0 : fallback;
+}
+
+double
+Touchpad::get_double(ParamId id, double fallback) {
+    double value;
+    return get_parameter(id, value) ? value : fallback;
+}
+
+int
+Touchpad::get_parameters(param_values& values) {
+    XStatsScope scope("get_parameters");
+    if (current)
+        return dp_get_parameters(current, values);
+    values.clear();
+    return 0;
 }
 
 void
 Touchpad::set_parameter(const char* name, double variable) {
-    if (display && device && variable != -1)
-        dp_set_parameter(display, device, name, variable);
+    XStatsScope scope("set_parameter");
+    Transaction transaction;
+    transaction.set(name, variable);
+    transaction.commit();
 }
 
-bool
-Touchpad::capability(const char* name) {
-    if (display && device) {
-	char *cap;
+void
+Touchpad::set_parameter(ParamId id, double variable) {
+    XStatsScope scope("set_parameter");
+    Transaction transaction;
+    transaction.set(id, variable);
+    transaction.commit();
+}
+
+Touchpad::Transaction::Transaction()
+{
+}
+
+Touchpad::Transaction::~Transaction()
+{
+}
+
+void
+Touchpad::Transaction::begin() {
+    pending.clear();
+}
+
+void
+Touchpad::Transaction::set(const char* name, double variable) {
+    if (variable == -1 || !parameters_map)
+        return;
+
+    /* keep the table's own name so callers may pass temporary strings */
+    param_hash::const_iterator p = parameters_map->find(name);
+    if (p != parameters_map->end())
+        pending[p->second->name] = variable;
+}
 
-	cap = (char *)dp_get_parameter(display, device, name);
-	if (cap)
-	    return *cap == 1;
+void
+Touchpad::Transaction::set(ParamId id, double variable) {
+    if (variable != -1)
+        pending[params[id].name] = variable;
+}
+
+int
+Touchpad::Transaction::commit() {
+    XStatsScope scope("Transaction::commit");
+    int count = 0;
+
+    if (current && !pending.empty())
+        count = dp_set_parameters(current, pending);
+    pending.clear();
+
+    return count;
+}
+
+int
+Touchpad::Transaction::commit(param_values& baseline) {
+    XStatsScope scope("Transaction::commit");
+    param_values written;
+    int count = 0;
+
+    param_values::iterator it = pending.begin();
+    while (it != pending.end()) {
+        param_values::iterator known = baseline.find(it->first);
+        /* compare as floats, the precision float properties are kept in */
+        if (known != baseline.end() && (float)known->second == (float)it->second)
+            pending.erase(it++);
+        else
+            ++it;
     }
 
+    if (current && !pending.empty())
+        count = dp_set_parameters(current, pending, &written);
+    pending.clear();
+
+    /* skipped parameters are tried again next time */
+    for (it = written.begin(); it != written.end(); ++it)
+        baseline[it->first] = it->second;
+
+    return count;
+}
+
+bool
+Touchpad::capability(ParamId id) {
+    return !current || !current->lacking[id];
+}
+
+bool
+Touchpad::available(ParamId id) {
+    return current && current->present[id];
+}
+
+bool
+Touchpad::get_device_state(snapshot_properties& state) {
+    state.clear();
+    if (!current)
+        return false;
+
+    Atom capabilities = dp_property_atom(SYNAPTICS_PROP_CAPABILITIES);
+    for (int j = 0; params[j].name; j++) {
+        Atom atom = param_atoms[j];
+        /* the driver's own, not to be set */
+        if (!current->present[j] || atom == capabilities)
+            continue;
+
+        /* parameters of one property share its atom */
+        int k;
+        for (k = 0; k < j; k++)
+            if (param_atoms[k] == atom)
+                break;
+        if (k < j)
+            continue;
+
+        const PropertyData& prop = current->mirror[atom];
+        SnapshotProperty entry;
+        if (prop.type == XA_INTEGER)
+            entry.kind = SNAPSHOT_INTEGER;
+        else if (prop.type == float_atom && float_atom)
+            entry.kind = SNAPSHOT_FLOAT;
+        else
+            continue;
+        entry.name = params[j].prop_name;
+        entry.format = prop.format;
+        entry.items = prop.items;
+        state.push_back(entry);
+    }
     return true;
 }
 
+int
+Touchpad::set_device_state(const snapshot_properties& state) {
+    XStatsScope scope("set_device_state");
+    if (!current)
+        return -1;
+
+    std::vector<Atom> atoms;
+    std::vector<PropertyData> props;
+    for (snapshot_properties::const_iterator p = state.begin(); p != state.end(); ++p) {
+        Atom atom = dp_property_atom(p->name.c_str());
+        Atom type = p->kind == SNAPSHOT_FLOAT ? float_atom : XA_INTEGER;
+        property_mirror::const_iterator m = current->mirror.find(atom);
+
+        /* the server would refuse what does not fit the driver any more */
+        if (!atom || !type || m == current->mirror.end() ||
+            m->second.type != type || m->second.format != p->format ||
+            m->second.items.size() != p->items.size()) {
+            fprintf(stderr, "Saved '%s' does not fit. Skipping.\n", p->name.c_str());
+            continue;
+        }
+        if (m->second.items == p->items)
+            continue;       /* as it is already */
+
+        PropertyData prop;
+        prop.type = type;
+        prop.format = p->format;
+        prop.items = p->items;
+        atoms.push_back(atom);
+        props.push_back(prop);
+    }
+
+    if (!atoms.empty())
+        current->backend->change_properties(atoms, props);
+    /* keep the mirror coherent until the property notify arrives */
+    for (size_t j = 0; j < atoms.size(); j++)
+        current->mirror[atoms[j]] = props[j];
+
+    return atoms.size();
+}
+
+bool
+Touchpad::save_snapshot(const char* path) {
+    XStatsScope scope("save_snapshot");
+    if (!current)
+        return false;
+
+    snapshot_devices snapshot;
+    snapshot_read(path, snapshot);  /* a new file otherwise */
+    get_device_state(snapshot[current->name]);
+    return snapshot_write(path, snapshot);
+}
+
+int
+Touchpad::restore_snapshot(const char* path) {
+    XStatsScope scope("restore_snapshot");
+    snapshot_devices snapshot;
+    if (!current || !snapshot_read(path, snapshot))
+        return -1;
+
+    snapshot_devices::const_iterator entry = snapshot.find(current->name);
+    if (entry == snapshot.end())
+        return -1;
+    return set_device_state(entry->second);
+}
+
 const char*
 Touchpad::get_device_name() {
-    return dev_name;
+    return current ? current->name : NULL;
+}
+
+const char*
+Touchpad::get_device_name(int id) {
+    touchpad_devices::const_iterator it = devices.find(id);
+    return it != devices.end() ? it->second->name : NULL;
+}
+
+int
+Touchpad::connection_number() {
+    return display ? ConnectionNumber(display) : -1;
+}
+
+bool
+Touchpad::events_queued() {
+    return display && XEventsQueued(display, QueuedAlready) > 0;
+}
+
+int
+Touchpad::process_events(prop_list& changed, device_list* added, device_list* removed) {
+    XStatsScope scope("process_events");
+    if (display)
+        return dp_process_events(display, &changed, NULL, added, removed);
+    return 0;
+}
+
+int
+Touchpad::process_events(device_changes& changed, device_list* added, device_list* removed) {
+    XStatsScope scope("process_events");
+    if (display)
+        return dp_process_events(display, NULL, &changed, added, removed);
+    return 0;
+}
+
+bool
+Touchpad::select_key_events(bool enable) {
+    XStatsScope scope("select_key_events");
+    if (!display || xi_opcode == -1)
+        return false;
+
+    /* masters only, slave devices would report every key twice */
+    unsigned char mask[XIMaskLen(XI_RawKeyPress)] = { 0 };
+    XIEventMask evmask;
+    evmask.deviceid = XIAllMasterDevices;
+    evmask.mask_len = sizeof(mask);
+    evmask.mask = mask;
+    if (enable)
+        XISetMask(mask, XI_RawKeyPress);
+    xstats_request(1, 12 + 4 + xstats_pad(sizeof(mask)));
+    XISelectEvents(display, DefaultRootWindow(display), &evmask, 1);
+    XFlush(display);
+
+    return true;
+}
+
+unsigned long
+Touchpad::key_press_count() {
+    return key_presses;
+}
+
+bool
+Touchpad::start_trace(const char* path) {
+    XStatsScope scope("start_trace");
+    if (!display || xi_opcode == -1 || !current)
+        return false;
+
+    dp_stop_trace(display);
+
+    int id = current->device->device_id;
+    int valuators = dp_trace_axes(display, id);
+
+    if (path) {
+        trace_writer = new TraceWriter;
+        if (!trace_writer->open(path, current->name, valuators)) {
+            delete trace_writer;
+            trace_writer = NULL;
+            return false;
+        }
+    }
+    trace_ring = new TraceRing(TRACE_RING_SIZE);
+    trace_device = id;
+    memset(&trace_state, 0, sizeof(trace_state));
+    /* as TraceReader returns them */
+    for (int v = 0; v < TRACE_VALUATORS; v++)
+        if (!(valuators & (1 << v)))
+            trace_state.values[v] = TRACE_NONE;
+
+    dp_select_raw_events(display, id, true);
+    return true;
+}
+
+int
+Touchpad::flush_trace() {
+    XStatsScope scope("flush_trace");
+    if (!trace_writer)
+        return 0;
+
+    TraceEvent ev;
+    int count = 0;
+    while (trace_ring->pop(ev)) {
+        trace_writer->write(ev);
+        count++;
+    }
+    trace_writer->flush();
+    return count;
+}
+
+bool
+Touchpad::next_trace_event(TraceEvent& event) {
+    return trace_ring && !trace_writer && trace_ring->pop(event);
+}
+
+void
+Touchpad::stop_trace() {
+    XStatsScope scope("stop_trace");
+    dp_stop_trace(display);
+}
+
+int
+Touchpad::get_trace_device() {
+    return trace_device;
+}
+
+int
+Touchpad::get_trace_minimum(int valuator) {
+    if (!trace_ring || valuator < 0 || valuator >= TRACE_VALUATORS)
+        return 0;
+    return trace_minimum[valuator];
+}
+
+int
+Touchpad::get_trace_absolute() {
+    if (!trace_ring)
+        return 0;
+
+    int mask = 0;
+    for (int v = 0; v < TRACE_VALUATORS; v++)
+        if (trace_axes[v] != -1 && !(trace_relative & (1 << v)))
+            mask |= 1 << v;
+    return mask;
+}
+
+const char*
+Touchpad::get_backend_name() {
+    return current ? current->backend->name() : NULL;
 }
 
 
 int
 Touchpad::free_xinput_extension() {
-    if (display && device) {
-        XCloseDevice(display, device);
+    XStatsScope scope("free_xinput_extension");
+    dp_stop_trace(display);
+    while (!devices.empty())
+        dp_remove_device(display, devices.begin()->first, false);
+    property_event_type = -1;
+    xi_opcode = -1;
+    key_presses = 0;
+
+    if (display) {
+        double start = xstats_start();
         XSync(display, True);
+        xstats_request(1, 4);
+        xstats_reply(start, 32);
         XCloseDisplay(display);
+        display = NULL;
     }
 
-    free(parameters_map);
-    free(properties_list);
-    free(dev_name);
+    delete parameters_map;
+    parameters_map = NULL;
+    properties_list.clear();
+    delete[] param_atoms;
+    param_atoms = NULL;
+    float_atom = touchpad_atom = None;
 
+    xstats_dump();
     return 0;
 }
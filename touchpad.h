@@ -30,9 +30,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <strings.h>
 #include <list>
+#include <map>
 
 #include "synaptics-properties.h"
+#include "touchpad_snapshot.h"
 
 #define GET_DISPLAY_FAILED -1
 #define GET_DEVICE_FAILED -2
@@ -48,6 +51,21 @@
 #define SBR_MAX 1000
 
 typedef std::list<const char*> prop_list;
+typedef std::list<int> device_list;
+/* device id -> names of its changed properties */
+typedef std::map<int, prop_list> device_changes;
+
+struct TraceEvent;
+
+struct ltstr
+{
+  bool operator()(const char* s1, const char* s2) const
+  {
+    return strcasecmp(s1, s2) < 0;
+  }
+};
+/* parameter name -> value, used for bulk reads */
+typedef std::map<const char*, double, ltstr> param_values;
 
 union flong { /* Xlibs 64-bit property handling madness */
     long l;
@@ -70,96 +88,231 @@ struct Parameter {
     int prop_offset;			    /* Offset inside property */
 };
 
-static struct Parameter params[] = {
-    {"LeftEdge",              PT_INT,    0, 10000, SYNAPTICS_PROP_EDGES,	32,	0},
-    {"RightEdge",             PT_INT,    0, 10000, SYNAPTICS_PROP_EDGES,	32,	1},
-    {"TopEdge",               PT_INT,    0, 10000, SYNAPTICS_PROP_EDGES,	32,	2},
-    {"BottomEdge",            PT_INT,    0, 10000, SYNAPTICS_PROP_EDGES,	32,	3},
-    {"FingerLow",             PT_INT,    0, 255,   SYNAPTICS_PROP_FINGER,	32,	0},
-    {"FingerHigh",            PT_INT,    0, 255,   SYNAPTICS_PROP_FINGER,	32,	1},
-    {"FingerPress",           PT_INT,    0, 256,   SYNAPTICS_PROP_FINGER,	32,	2},
-    {"MaxTapTime",            PT_INT,    0, 1000,  SYNAPTICS_PROP_TAP_TIME,	32,	0},
-    {"MaxTapMove",            PT_INT,    0, 2000,  SYNAPTICS_PROP_TAP_MOVE,	32,	0},
-    {"MaxDoubleTapTime",      PT_INT,    0, 1000,  SYNAPTICS_PROP_TAP_DURATIONS,32,	1},
-    {"SingleTapTimeout",      PT_INT,    0, 1000,  SYNAPTICS_PROP_TAP_DURATIONS,32,	0},
-    {"ClickTime",             PT_INT,    0, 1000,  SYNAPTICS_PROP_TAP_DURATIONS,32,	2},
-    {"FastTaps",              PT_BOOL,   0, 1,     SYNAPTICS_PROP_TAP_FAST,	8,	0},
-    {"EmulateMidButtonTime",  PT_INT,    0, 1000,  SYNAPTICS_PROP_MIDDLE_TIMEOUT,32,	0},
-    {"EmulateTwoFingerMinZ",  PT_INT,    0, 1000,  SYNAPTICS_PROP_TWOFINGER_PRESSURE,	32,	0},
-    {"EmulateTwoFingerMinW",  PT_INT,    0, 15,    SYNAPTICS_PROP_TWOFINGER_WIDTH,	32,	0},
-    {"VertScrollDelta",       PT_INT,    0, 1000,  SYNAPTICS_PROP_SCROLL_DISTANCE,	32,	0},
-    {"HorizScrollDelta",      PT_INT,    0, 1000,  SYNAPTICS_PROP_SCROLL_DISTANCE,	32,	1},
-    {"VertEdgeScroll",        PT_BOOL,   0, 1,     SYNAPTICS_PROP_SCROLL_EDGE,	8,	0},
-    {"HorizEdgeScroll",       PT_BOOL,   0, 1,     SYNAPTICS_PROP_SCROLL_EDGE,	8,	1},
-    {"CornerCoasting",        PT_BOOL,   0, 1,     SYNAPTICS_PROP_SCROLL_EDGE,	8,	2},
-    {"VertTwoFingerScroll",   PT_BOOL,   0, 1,     SYNAPTICS_PROP_SCROLL_TWOFINGER,	8,	0},
-    {"HorizTwoFingerScroll",  PT_BOOL,   0, 1,     SYNAPTICS_PROP_SCROLL_TWOFINGER,	8,	1},
-    {"MinSpeed",              PT_DOUBLE, 0, 1.0,   SYNAPTICS_PROP_SPEED,	0, /*float */	0},
-    {"MaxSpeed",              PT_DOUBLE, 0, 1.0,   SYNAPTICS_PROP_SPEED,	0, /*float */	1},
-    {"AccelFactor",           PT_DOUBLE, 0, 1.0,   SYNAPTICS_PROP_SPEED,	0, /*float */	2},
-    {"TrackstickSpeed",       PT_DOUBLE, 0, 200.0, SYNAPTICS_PROP_SPEED,	0, /*float */ 3},
-    {"EdgeMotionMinZ",        PT_INT,    1, 255,   SYNAPTICS_PROP_EDGEMOTION_PRESSURE,  32,	0},
-    {"EdgeMotionMaxZ",        PT_INT,    1, 255,   SYNAPTICS_PROP_EDGEMOTION_PRESSURE,  32,	1},
-    {"EdgeMotionMinSpeed",    PT_INT,    0, 1000,  SYNAPTICS_PROP_EDGEMOTION_SPEED,     32,	0},
-    {"EdgeMotionMaxSpeed",    PT_INT,    0, 1000,  SYNAPTICS_PROP_EDGEMOTION_SPEED,     32,	1},
-    {"EdgeMotionUseAlways",   PT_BOOL,   0, 1,     SYNAPTICS_PROP_EDGEMOTION,   8,	0},
-    {"UpDownScrolling",       PT_BOOL,   0, 1,     SYNAPTICS_PROP_BUTTONSCROLLING,  8,	0},
-    {"LeftRightScrolling",    PT_BOOL,   0, 1,     SYNAPTICS_PROP_BUTTONSCROLLING,  8,	1},
-    {"UpDownScrollRepeat",    PT_BOOL,   0, 1,     SYNAPTICS_PROP_BUTTONSCROLLING_REPEAT,   8,	0},
-    {"LeftRightScrollRepeat", PT_BOOL,   0, 1,     SYNAPTICS_PROP_BUTTONSCROLLING_REPEAT,   8,	1},
-    {"ScrollButtonRepeat",    PT_INT,    SBR_MIN , SBR_MAX, SYNAPTICS_PROP_BUTTONSCROLLING_TIME, 32,	0},
-    {"TouchpadOff",           PT_INT,    0, 2,     SYNAPTICS_PROP_OFF,		8,	0},
-    {"GuestMouseOff",         PT_BOOL,   0, 1,     SYNAPTICS_PROP_GUESTMOUSE,	8,	0},
-    {"LockedDrags",           PT_BOOL,   0, 1,     SYNAPTICS_PROP_LOCKED_DRAGS,	8,	0},
-    {"LockedDragTimeout",     PT_INT,    0, 30000, SYNAPTICS_PROP_LOCKED_DRAGS_TIMEOUT,	32,	0},
-    {"RTCornerButton",        PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_TAP_ACTION,	8,	0},
-    {"RBCornerButton",        PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_TAP_ACTION,	8,	1},
-    {"LTCornerButton",        PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_TAP_ACTION,	8,	2},
-    {"LBCornerButton",        PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_TAP_ACTION,	8,	3},
-    {"TapButton1",            PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_TAP_ACTION,	8,	4},
-    {"TapButton2",            PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_TAP_ACTION,	8,	5},
-    {"TapButton3",            PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_TAP_ACTION,	8,	6},
-    {"ClickFinger1",          PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_CLICK_ACTION,	8,	0},
-    {"ClickFinger2",          PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_CLICK_ACTION,	8,	1},
-    {"ClickFinger3",          PT_INT,    0, SYN_MAX_BUTTONS, SYNAPTICS_PROP_CLICK_ACTION,	8,	2},
-    {"CircularScrolling",     PT_BOOL,   0, 1,     SYNAPTICS_PROP_CIRCULAR_SCROLLING,	8,	0},
-    {"CircScrollDelta",       PT_DOUBLE, .01, 3,   SYNAPTICS_PROP_CIRCULAR_SCROLLING_DIST,	0 /* float */,	0},
-    {"CircScrollTrigger",     PT_INT,    0, 8,     SYNAPTICS_PROP_CIRCULAR_SCROLLING_TRIGGER,	8,	0},
-    {"CircularPad",           PT_BOOL,   0, 1,     SYNAPTICS_PROP_CIRCULAR_PAD,	8,	0},
-    {"PalmDetect",            PT_BOOL,   0, 1,     SYNAPTICS_PROP_PALM_DETECT,	8,	0},
-    {"PalmMinWidth",          PT_INT,    0, 15,    SYNAPTICS_PROP_PALM_DIMENSIONS,	32,	0},
-    {"PalmMinZ",              PT_INT,    0, 255,   SYNAPTICS_PROP_PALM_DIMENSIONS,	32,	1},
-    {"CoastingSpeed",         PT_DOUBLE, 0, 20,    SYNAPTICS_PROP_COASTING_SPEED,	0 /* float*/,	0},
-    {"PressureMotionMinZ",    PT_INT,    1, 255,   SYNAPTICS_PROP_PRESSURE_MOTION,	32,	0},
-    {"PressureMotionMaxZ",    PT_INT,    1, 255,   SYNAPTICS_PROP_PRESSURE_MOTION,	32,	1},
-    {"PressureMotionMinFactor", PT_DOUBLE, 0, 10.0,SYNAPTICS_PROP_PRESSURE_MOTION_FACTOR,	0 /*float*/,	0},
-    {"PressureMotionMaxFactor", PT_DOUBLE, 0, 10.0,SYNAPTICS_PROP_PRESSURE_MOTION_FACTOR,	0 /*float*/,	1},
-    {"GrabEventDevice",       PT_BOOL,   0, 1,     SYNAPTICS_PROP_GRAB,	8,	0},
-    {"TapAndDragGesture",     PT_BOOL,   0, 1,     SYNAPTICS_PROP_GESTURES,	8,	0},
-    {"AreaLeftEdge",          PT_INT,    0, 10000, SYNAPTICS_PROP_AREA,	32,	0},
-    {"AreaRightEdge",         PT_INT,    0, 10000, SYNAPTICS_PROP_AREA,	32,	1},
-    {"AreaTopEdge",           PT_INT,    0, 10000, SYNAPTICS_PROP_AREA,	32,	2},
-    {"AreaBottomEdge",        PT_INT,    0, 10000, SYNAPTICS_PROP_AREA,	32,	3},
-    {"_CapLeftButton",        PT_BOOL,   0, 1,     SYNAPTICS_PROP_CAPABILITIES,	8,	0},
-    {"_CapMiddleButton",      PT_BOOL,   0, 1,     SYNAPTICS_PROP_CAPABILITIES,	8,	1},
-    {"_CapRightButton",       PT_BOOL,   0, 1,     SYNAPTICS_PROP_CAPABILITIES,	8,	2},
-    {"_CapTwoFingers",        PT_BOOL,   0, 1,     SYNAPTICS_PROP_CAPABILITIES,	8,	3},
-    {"_CapThreeFingers",      PT_BOOL,   0, 1,     SYNAPTICS_PROP_CAPABILITIES,	8,	4},
-    { NULL, ParaType(0), 0, 0, 0, 0, 0           }
+/*
+ * Index of every params[] entry, in table order. Access by id skips the
+ * name lookup.
+ */
+enum ParamId {
+    P_LEFT_EDGE,
+    P_RIGHT_EDGE,
+    P_TOP_EDGE,
+    P_BOTTOM_EDGE,
+    P_FINGER_LOW,
+    P_FINGER_HIGH,
+    P_FINGER_PRESS,
+    P_MAX_TAP_TIME,
+    P_MAX_TAP_MOVE,
+    P_MAX_DOUBLE_TAP_TIME,
+    P_SINGLE_TAP_TIMEOUT,
+    P_CLICK_TIME,
+    P_FAST_TAPS,
+    P_EMULATE_MID_BUTTON_TIME,
+    P_EMULATE_TWO_FINGER_MIN_Z,
+    P_EMULATE_TWO_FINGER_MIN_W,
+    P_VERT_SCROLL_DELTA,
+    P_HORIZ_SCROLL_DELTA,
+    P_VERT_EDGE_SCROLL,
+    P_HORIZ_EDGE_SCROLL,
+    P_CORNER_COASTING,
+    P_VERT_TWO_FINGER_SCROLL,
+    P_HORIZ_TWO_FINGER_SCROLL,
+    P_MIN_SPEED,
+    P_MAX_SPEED,
+    P_ACCEL_FACTOR,
+    P_TRACKSTICK_SPEED,
+    P_EDGE_MOTION_MIN_Z,
+    P_EDGE_MOTION_MAX_Z,
+    P_EDGE_MOTION_MIN_SPEED,
+    P_EDGE_MOTION_MAX_SPEED,
+    P_EDGE_MOTION_USE_ALWAYS,
+    P_UP_DOWN_SCROLLING,
+    P_LEFT_RIGHT_SCROLLING,
+    P_UP_DOWN_SCROLL_REPEAT,
+    P_LEFT_RIGHT_SCROLL_REPEAT,
+    P_SCROLL_BUTTON_REPEAT,
+    P_TOUCHPAD_OFF,
+    P_GUEST_MOUSE_OFF,
+    P_LOCKED_DRAGS,
+    P_LOCKED_DRAG_TIMEOUT,
+    P_RT_CORNER_BUTTON,
+    P_RB_CORNER_BUTTON,
+    P_LT_CORNER_BUTTON,
+    P_LB_CORNER_BUTTON,
+    P_TAP_BUTTON1,
+    P_TAP_BUTTON2,
+    P_TAP_BUTTON3,
+    P_CLICK_FINGER1,
+    P_CLICK_FINGER2,
+    P_CLICK_FINGER3,
+    P_CIRCULAR_SCROLLING,
+    P_CIRC_SCROLL_DELTA,
+    P_CIRC_SCROLL_TRIGGER,
+    P_CIRCULAR_PAD,
+    P_PALM_DETECT,
+    P_PALM_MIN_WIDTH,
+    P_PALM_MIN_Z,
+    P_COASTING_SPEED,
+    P_PRESSURE_MOTION_MIN_Z,
+    P_PRESSURE_MOTION_MAX_Z,
+    P_PRESSURE_MOTION_MIN_FACTOR,
+    P_PRESSURE_MOTION_MAX_FACTOR,
+    P_GRAB_EVENT_DEVICE,
+    P_TAP_AND_DRAG_GESTURE,
+    P_AREA_LEFT_EDGE,
+    P_AREA_RIGHT_EDGE,
+    P_AREA_TOP_EDGE,
+    P_AREA_BOTTOM_EDGE,
+    P_CAP_LEFT_BUTTON,
+    P_CAP_MIDDLE_BUTTON,
+    P_CAP_RIGHT_BUTTON,
+    P_CAP_TWO_FINGERS,
+    P_CAP_THREE_FINGERS,
+    PARAM_COUNT
 };
 
+/* PARAM_COUNT entries followed by a NULL terminated one */
+extern const struct Parameter params[];
+
 namespace Touchpad {
 
     int init_xinput_extension();
     int free_xinput_extension();
 
+    /* the distinct synaptics properties of the open devices */
     const prop_list* get_properties_list();
-    const void* get_parameter(const char* name);
+
+    /*
+     * Every synaptics device is opened, each identified by its XI device
+     * id. Parameter access works on the selected one, initially the
+     * device the old single-device code picked.
+     */
+    const device_list& get_devices();
+    bool select_device(int id);
+    int get_current_device();
+
+    /*
+     * Typed access to a single parameter of the current device. Reads come
+     * from the property mirror and allocate nothing; fallback is returned
+     * when the parameter cannot be read.
+     */
+    bool get_parameter(ParamId id, double& value);
+    int get_int(ParamId id, int fallback = -1);
+    bool get_bool(ParamId id, bool fallback = false);
+    double get_double(ParamId id, double fallback = -1);
+
+    int get_parameters(param_values& values);
     void set_parameter(const char* name, double variable);
+    void set_parameter(ParamId id, double variable);
+
+    /*
+     * Buffers parameter writes and sends them on commit(), merged
+     * into a single property change per property. Values of -1 are
+     * ignored, like with set_parameter().
+     */
+    class Transaction {
+    public:
+        Transaction();
+        ~Transaction();
+
+        void begin();
+        void set(const char* name, double variable);
+        void set(ParamId id, double variable);
+        int commit();
+        /*
+         * Sends only the values which differ from baseline (the values
+         * the driver is known to hold) and records those sent in it;
+         * parameters the device lacks or which do not fit their
+         * property stay as they were there.
+         */
+        int commit(param_values& baseline);
+
+    private:
+        param_values pending;
+    };
+
+    /*
+     * Both answered from an index built when the device is opened and kept
+     * current by property notify events.
+     * capability(): true unless the device reports it lacks the capability
+     * available(): true when the device has the property of the parameter
+     */
+    bool capability(ParamId id);
+    bool available(ParamId id);
+
+    /*
+     * Property values are mirrored in memory and kept current by property
+     * notify events. Call process_events() when connection_number() becomes
+     * readable; it fills the names of the changed properties of the current
+     * device and the ids of devices which appeared or went away.
+     * Requests with replies made outside process_events() read the events
+     * arriving meanwhile into the queue of Xlib, where the connection does
+     * not show them; events_queued() tells whether process_events() should
+     * be called anyway.
+     */
+    int connection_number();
+    bool events_queued();
+    int process_events(prop_list& changed, device_list* added = NULL,
+                       device_list* removed = NULL);
+    /* the same, for every device */
+    int process_events(device_changes& changed, device_list* added = NULL,
+                       device_list* removed = NULL);
+
+    /*
+     * Counts raw key presses of all keyboards while enabled; the count is
+     * updated by process_events(). Needs XInput 2, returns false otherwise.
+     */
+    bool select_key_events(bool enable);
+    unsigned long key_press_count();
+
+    /*
+     * Records raw motion and button events of the current device, with the
+     * position, pressure and finger width it reports, to a trace file (see
+     * touchpad_trace.h). process_events() queues them in a fixed size ring
+     * and flush_trace() writes them out; process_events() flushes too when
+     * the ring fills up. All of these, next_trace_event() and stop_trace()
+     * included, must be called on the thread calling process_events().
+     * Needs XInput 2. Tracing stops when the device goes away.
+     * Without a path nothing is written; the caller takes the events with
+     * next_trace_event() instead.
+     */
+    bool start_trace(const char* path);
+    /* returns the number of events written */
+    int flush_trace();
+    /* false when no event is queued, or they go to a file */
+    bool next_trace_event(TraceEvent& event);
+    void stop_trace();
+    /* -1 unless tracing */
+    int get_trace_device();
+    /* bit v set when valuator v is an absolute axis, 0 unless tracing */
+    int get_trace_absolute();
+    /* the lowest value absolute valuator v may report, which some
+     * touchpads put below 0; 0 unless tracing */
+    int get_trace_minimum(int valuator);
 
-    bool capability(const char* name);
+    /*
+     * Saves the synaptics properties of the current device, as they are,
+     * to a snapshot file (see touchpad_snapshot.h), replacing the device's
+     * earlier entry and keeping those of other devices. Only properties
+     * with parameters in params[] are mirrored and saved; the read-only
+     * capabilities are not.
+     * restore_snapshot() puts the entry of the current device, found by
+     * name, back with one property change per property and no reads.
+     * Properties whose type or size changed since are left alone. Returns
+     * the number of properties restored, -1 without an entry.
+     */
+    bool save_snapshot(const char* path);
+    int restore_snapshot(const char* path);
+    /*
+     * The same without a file: the state of the current device from the
+     * mirror, and pushing such a state back. set_device_state() returns
+     * the number of properties changed, -1 without a device.
+     */
+    bool get_device_state(snapshot_properties& state);
+    int set_device_state(const snapshot_properties& state);
 
     const char* get_device_name();
+    const char* get_device_name(int id);
+    const char* get_backend_name();
 }
 
 namespace Synaptics {
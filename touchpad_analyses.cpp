@@ -0,0 +1,160 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#include <stddef.h>
+
+#include "touchpad.h"
+#include "touchpad_analyses.h"
+
+RawEventAnalyses::RawEventAnalyses()
+    : latency(NULL), calibration(NULL), touches(NULL)
+{
+}
+
+RawEventAnalyses::~RawEventAnalyses()
+{
+    stop();
+}
+
+bool
+RawEventAnalyses::start_trace()
+{
+    stop();
+    return Touchpad::start_trace(NULL);
+}
+
+bool
+RawEventAnalyses::start_tap_latency()
+{
+    if (!start_trace())
+        return false;
+    latency = new TapLatency;
+    follow_parameters();
+    return true;
+}
+
+bool
+RawEventAnalyses::start_calibration()
+{
+    const int position = (1 << TRACE_X) | (1 << TRACE_Y);
+
+    if (!start_trace())
+        return false;
+    /* relative devices have no edges to find */
+    if ((Touchpad::get_trace_absolute() & position) != position) {
+        Touchpad::stop_trace();
+        return false;
+    }
+    calibration = new EdgeCalibrator;
+    calibration->set_origin(Touchpad::get_trace_minimum(TRACE_X),
+                            Touchpad::get_trace_minimum(TRACE_Y));
+    return true;
+}
+
+bool
+RawEventAnalyses::start_heatmap()
+{
+    if (!start_trace())
+        return false;
+    touches = new TouchHeatmap;
+    follow_parameters();
+    return true;
+}
+
+void
+RawEventAnalyses::stop()
+{
+    if (!latency && !calibration && !touches)
+        return;
+
+    Touchpad::stop_trace();
+    delete latency;
+    delete calibration;
+    delete touches;
+    latency = NULL;
+    calibration = NULL;
+    touches = NULL;
+}
+
+void
+RawEventAnalyses::events_processed()
+{
+    TraceEvent event;
+
+    if (!latency && !calibration && !touches)
+        return;
+
+    while (Touchpad::next_trace_event(event)) {
+        if (latency)
+            latency->add(event);
+        else if (calibration)
+            calibration->add(event);
+        else
+            touches->add(event);
+    }
+    /* the device went away */
+    if (Touchpad::get_trace_device() == -1)
+        stop();
+}
+
+void
+RawEventAnalyses::parameters_changed(int device)
+{
+    if (device == Touchpad::get_trace_device())
+        follow_parameters();
+}
+
+/*
+ * Sensitivity changes move the finger thresholds and new edges move the
+ * grid; the edges found by calibration do not depend on either.
+ */
+void
+RawEventAnalyses::follow_parameters()
+{
+    if (latency)
+        latency->set_thresholds(Touchpad::get_int(P_FINGER_LOW, 25),
+                                Touchpad::get_int(P_FINGER_HIGH, 30));
+    if (touches)
+        touches->set_edges(Touchpad::get_int(P_LEFT_EDGE), Touchpad::get_int(P_RIGHT_EDGE),
+                           Touchpad::get_int(P_TOP_EDGE), Touchpad::get_int(P_BOTTOM_EDGE));
+}
+
+TapLatency*
+RawEventAnalyses::tap_latency() const
+{
+    return latency;
+}
+
+EdgeCalibrator*
+RawEventAnalyses::calibrator() const
+{
+    return calibration;
+}
+
+TouchHeatmap*
+RawEventAnalyses::heatmap() const
+{
+    return touches;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#ifndef _TOUCHPAD_ANALYSES_H
+#define	_TOUCHPAD_ANALYSES_H
+
+#include "touchpad_trace.h"
+#include "touchpad_calibrate.h"
+#include "touchpad_heatmap.h"
+
+/*
+ * The analyses of the raw events of a device, run by the touchpad service
+ * and, without it, by the control module itself. One runs at a time, on
+ * the trace ring of the Touchpad namespace (start_trace(NULL)), so
+ * starting one ends the other; none can run along with a trace file.
+ *
+ * Like the trace, it is driven from the thread calling
+ * Touchpad::process_events(): events_processed() after each call feeds
+ * the queued events to the analysis, which ends by itself when its device
+ * goes away, and parameters_changed() keeps it following the parameters
+ * it depends on.
+ */
+class RawEventAnalyses {
+public:
+    RawEventAnalyses();
+    ~RawEventAnalyses();
+
+    /*
+     * Start an analysis of the selected device, see TapLatency,
+     * EdgeCalibrator and TouchHeatmap; false when its events cannot be
+     * had. Calibration needs absolute coordinates.
+     */
+    bool start_tap_latency();
+    bool start_calibration();
+    bool start_heatmap();
+    /* ends the running analysis, if any */
+    void stop();
+
+    void events_processed();
+    /* the parameters of the given device changed; it is the selected one */
+    void parameters_changed(int device);
+
+    /* the running analysis, NULL when another one or none runs */
+    TapLatency* tap_latency() const;
+    EdgeCalibrator* calibrator() const;
+    TouchHeatmap* heatmap() const;
+
+private:
+    bool start_trace();
+    void follow_parameters();
+
+    TapLatency* latency;
+    EdgeCalibrator* calibration;
+    TouchHeatmap* touches;
+};
+
+#endif	/* _TOUCHPAD_ANALYSES_H */
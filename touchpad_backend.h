@@ -0,0 +1,121 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#ifndef _TOUCHPAD_BACKEND_H
+#define	_TOUCHPAD_BACKEND_H
+
+#include <X11/Xlib.h>
+#include <X11/extensions/XInput.h>
+
+#include <vector>
+
+/*
+ * Contents of one device property. Items are stored one per long whatever
+ * the property format is; floats keep their bit pattern (see union flong),
+ * the same way Xlib hands out 32-bit properties.
+ * A property which does not exist has type None and no items.
+ */
+struct PropertyData {
+    Atom type;
+    int format;
+    std::vector<long> items;
+
+    PropertyData() : type(None), format(0) {}
+};
+
+/*
+ * Device property I/O used by touchpad.cpp. Both calls work on a batch,
+ * so implementations able to pipeline requests pay one round trip for
+ * all of them.
+ */
+class PropertyBackend {
+public:
+    virtual ~PropertyBackend() {}
+
+    virtual const char* name() const = 0;
+
+    /* lengths are in 32-bit units, like XGetDeviceProperty's long_length */
+    virtual void get_properties(const std::vector<Atom>& props,
+                                const std::vector<long>& lengths,
+                                std::vector<PropertyData>& out) = 0;
+    virtual void change_properties(const std::vector<Atom>& props,
+                                   const std::vector<PropertyData>& data) = 0;
+};
+
+PropertyBackend* create_xlib_backend(Display* dpy, XDevice* dev);
+#ifdef HAVE_XCB_XINPUT
+PropertyBackend* create_xcb_backend(Display* dpy, XDevice* dev);
+#endif
+
+/*
+ * In-memory synaptics device used with KCM_TOUCHPAD_BACKEND=fake, so the
+ * code can be exercised and measured without an X server. Every request
+ * waiting for a reply is delayed by KCM_TOUCHPAD_FAKE_LATENCY ms (or the
+ * value given to fake_device_set_latency()).
+ */
+struct FakeDeviceCounters {
+    unsigned long requests;
+    unsigned long round_trips;
+
+    FakeDeviceCounters() : requests(0), round_trips(0) {}
+};
+
+PropertyBackend* create_fake_backend();
+void fake_intern_atoms(char** names, int count, Atom* atoms);
+const char* fake_device_name();
+/* restores the driver defaults and zeroes the counters */
+void fake_device_reset();
+FakeDeviceCounters fake_device_counters();
+void fake_device_set_latency(double ms);
+
+/*
+ * Accounting of X protocol traffic, enabled by KCM_TOUCHPAD_XSTATS=1 and
+ * printed by free_xinput_extension(). Traffic is booked to the Touchpad
+ * API call in progress. Callers report each request with its encoded size
+ * and each reply they wait for with the time since xstats_start(); all of
+ * it is a no-op when disabled.
+ */
+bool xstats_enabled();
+void xstats_enter(const char* entry);
+void xstats_leave();
+double xstats_start();
+void xstats_request(unsigned long requests, unsigned long bytes_out);
+void xstats_reply(double start, unsigned long bytes_in);
+void xstats_dump();
+
+/* Books the traffic of the enclosing scope to entry, unless nested */
+struct XStatsScope {
+    XStatsScope(const char* entry) { xstats_enter(entry); }
+    ~XStatsScope() { xstats_leave(); }
+};
+
+/* protocol data is padded to 4 bytes */
+inline unsigned long
+xstats_pad(unsigned long bytes)
+{
+    return (bytes + 3) & ~3UL;
+}
+
+#endif	/* _TOUCHPAD_BACKEND_H */
@@ -0,0 +1,265 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "touchpad_calibrate.h"
+
+EdgeCalibrator::EdgeCalibrator()
+{
+    origin[TRACE_X] = origin[TRACE_Y] = 0;
+    reset();
+}
+
+void
+EdgeCalibrator::reset()
+{
+    pending = 0;
+    count = 0;
+    dropped = 0;
+    low[TRACE_X] = low[TRACE_Y] = CALIBRATE_RANGE;
+    high[TRACE_X] = high[TRACE_Y] = -1;
+    memset(histogram, 0, sizeof(histogram));
+}
+
+void
+EdgeCalibrator::set_origin(int x, int y)
+{
+    origin[TRACE_X] = x;
+    origin[TRACE_Y] = y;
+    reset();
+}
+
+void
+EdgeCalibrator::add(const TraceEvent& event)
+{
+    if (event.type != TRACE_MOTION)
+        return;
+    if (event.values[TRACE_X] == TRACE_NONE || event.values[TRACE_Y] == TRACE_NONE)
+        return;
+    /* hovering or lifted fingers report stale positions */
+    if (event.values[TRACE_PRESSURE] != TRACE_NONE && event.values[TRACE_PRESSURE] <= 0)
+        return;
+
+    /* clamping would pile them up at the range, making up an edge */
+    int x = event.values[TRACE_X] - origin[TRACE_X];
+    int y = event.values[TRACE_Y] - origin[TRACE_Y];
+    if (x < 0 || x >= CALIBRATE_RANGE || y < 0 || y >= CALIBRATE_RANGE) {
+        dropped++;
+        return;
+    }
+
+    block_x[pending] = x;
+    block_y[pending] = y;
+    if (++pending == CALIBRATE_BLOCK)
+        flush();
+}
+
+void
+EdgeCalibrator::flush()
+{
+    if (!pending)
+        return;
+    unsigned n = pending;
+    pending = 0;
+    add_block(block_x, block_y, n);
+}
+
+static inline int
+clamp_coordinate(int v)
+{
+    return v < 0 ? 0 : (v >= CALIBRATE_RANGE ? CALIBRATE_RANGE - 1 : v);
+}
+
+#ifdef __SSE2__
+/* SSE2 has no signed 32-bit min/max, select with a compare instead */
+static inline __m128i
+min_epi32(__m128i a, __m128i b)
+{
+    __m128i greater = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(greater, b), _mm_andnot_si128(greater, a));
+}
+
+static inline __m128i
+max_epi32(__m128i a, __m128i b)
+{
+    __m128i greater = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(greater, a), _mm_andnot_si128(greater, b));
+}
+
+static inline int
+horizontal(__m128i v, bool maximum)
+{
+    int lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, v);
+    int result = lanes[0];
+    for (int k = 1; k < 4; k++)
+        if (maximum ? lanes[k] > result : lanes[k] < result)
+            result = lanes[k];
+    return result;
+}
+#endif
+
+void
+EdgeCalibrator::add_block(const int* x, const int* y, unsigned n)
+{
+    unsigned i = 0;
+    unsigned long* hx = histogram[TRACE_X];
+    unsigned long* hy = histogram[TRACE_Y];
+
+#ifdef __SSE2__
+    if (n >= 4) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i top = _mm_set1_epi32(CALIBRATE_RANGE - 1);
+        __m128i min_x = _mm_set1_epi32(low[TRACE_X]);
+        __m128i max_x = _mm_set1_epi32(high[TRACE_X]);
+        __m128i min_y = _mm_set1_epi32(low[TRACE_Y]);
+        __m128i max_y = _mm_set1_epi32(high[TRACE_Y]);
+        int bins[8];
+
+        for (; i + 4 <= n; i += 4) {
+            __m128i vx = _mm_loadu_si128((const __m128i*)(x + i));
+            __m128i vy = _mm_loadu_si128((const __m128i*)(y + i));
+            /* extremes are kept clamped, like the histogram */
+            vx = min_epi32(max_epi32(vx, zero), top);
+            vy = min_epi32(max_epi32(vy, zero), top);
+            min_x = min_epi32(min_x, vx);
+            max_x = max_epi32(max_x, vx);
+            min_y = min_epi32(min_y, vy);
+            max_y = max_epi32(max_y, vy);
+            _mm_storeu_si128((__m128i*)bins, _mm_srli_epi32(vx, CALIBRATE_SHIFT));
+            _mm_storeu_si128((__m128i*)(bins + 4), _mm_srli_epi32(vy, CALIBRATE_SHIFT));
+            hx[bins[0]]++; hx[bins[1]]++; hx[bins[2]]++; hx[bins[3]]++;
+            hy[bins[4]]++; hy[bins[5]]++; hy[bins[6]]++; hy[bins[7]]++;
+        }
+
+        low[TRACE_X] = horizontal(min_x, false);
+        high[TRACE_X] = horizontal(max_x, true);
+        low[TRACE_Y] = horizontal(min_y, false);
+        high[TRACE_Y] = horizontal(max_y, true);
+    }
+#endif
+
+    for (; i < n; i++) {
+        int vx = clamp_coordinate(x[i]);
+        int vy = clamp_coordinate(y[i]);
+        if (vx < low[TRACE_X])
+            low[TRACE_X] = vx;
+        if (vx > high[TRACE_X])
+            high[TRACE_X] = vx;
+        if (vy < low[TRACE_Y])
+            low[TRACE_Y] = vy;
+        if (vy > high[TRACE_Y])
+            high[TRACE_Y] = vy;
+        hx[vx >> CALIBRATE_SHIFT]++;
+        hy[vy >> CALIBRATE_SHIFT]++;
+    }
+
+    count += n;
+}
+
+unsigned long
+EdgeCalibrator::samples() const
+{
+    return count + pending;
+}
+
+unsigned long
+EdgeCalibrator::outside() const
+{
+    return dropped;
+}
+
+int
+EdgeCalibrator::minimum(int axis) const
+{
+    return count ? origin[axis] + low[axis] : 0;
+}
+
+int
+EdgeCalibrator::maximum(int axis) const
+{
+    return count ? origin[axis] + high[axis] : 0;
+}
+
+int
+EdgeCalibrator::percentile(int axis, double fraction) const
+{
+    if (!count)
+        return 0;
+
+    /* nearest rank, then the middle of its bin within the extremes */
+    unsigned long rank = (unsigned long)(fraction * count + 0.999999);
+    if (!rank)
+        rank = 1;
+    unsigned long seen = 0;
+    int bin = 0;
+    for (; bin < CALIBRATE_BINS - 1; bin++) {
+        seen += histogram[axis][bin];
+        if (seen >= rank)
+            break;
+    }
+
+    int value = (bin << CALIBRATE_SHIFT) + (1 << CALIBRATE_SHIFT) / 2;
+    if (value < low[axis])
+        value = low[axis];
+    if (value > high[axis])
+        value = high[axis];
+    return origin[axis] + value;
+}
+
+bool
+EdgeCalibrator::propose(param_values& values)
+{
+    flush();
+    if (count < CALIBRATE_MIN_SAMPLES)
+        return false;
+    if (dropped > (count + dropped) * CALIBRATE_CUTOFF)
+        return false;
+
+    int left = percentile(TRACE_X, CALIBRATE_CUTOFF);
+    int right = percentile(TRACE_X, 1 - CALIBRATE_CUTOFF);
+    int top = percentile(TRACE_Y, CALIBRATE_CUTOFF);
+    int bottom = percentile(TRACE_Y, 1 - CALIBRATE_CUTOFF);
+    if (right <= left || bottom <= top)
+        return false;
+
+    int inset_x = (int)((right - left) * EDGE_INSET_X);
+    int inset_y = (int)((bottom - top) * EDGE_INSET_Y);
+
+    values[params[P_LEFT_EDGE].name] = left + inset_x;
+    values[params[P_RIGHT_EDGE].name] = right - inset_x;
+    values[params[P_TOP_EDGE].name] = top + inset_y;
+    values[params[P_BOTTOM_EDGE].name] = bottom - inset_y;
+    values[params[P_AREA_LEFT_EDGE].name] = left;
+    values[params[P_AREA_RIGHT_EDGE].name] = right;
+    values[params[P_AREA_TOP_EDGE].name] = top;
+    values[params[P_AREA_BOTTOM_EDGE].name] = bottom;
+    return true;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#ifndef _TOUCHPAD_CALIBRATE_H
+#define	_TOUCHPAD_CALIBRATE_H
+
+#include "touchpad.h"
+#include "touchpad_trace.h"
+
+/*
+ * Finds the range of the absolute coordinates a touchpad reports while
+ * the finger sweeps over all of it, and proposes edges from it.
+ *
+ * Coordinates are taken relative to an origin, the minimum the device
+ * declares for its axes (see Touchpad::get_trace_minimum()), as some
+ * touchpads report negative ones. Samples falling outside CALIBRATE_RANGE
+ * from there are only counted; when more than CALIBRATE_CUTOFF of them
+ * do, no edges are proposed rather than edges cut off at the range.
+ *
+ * Samples are gathered in blocks of CALIBRATE_BLOCK. Each full block is
+ * reduced at once, with SSE2 where available: minimum and maximum per
+ * axis, and the coordinates clamped and scaled to bins of a histogram per
+ * axis. Nothing is kept per sample, so the cost per event is a few
+ * nanoseconds and any number of events fits.
+ * Stray readings are cut off by taking the extents from the histograms,
+ * at CALIBRATE_CUTOFF of the samples on either side.
+ */
+#define CALIBRATE_BLOCK     64
+#define CALIBRATE_RANGE     16384   /* from the origin, see outside() */
+#define CALIBRATE_SHIFT     4       /* 16 units per histogram bin */
+#define CALIBRATE_BINS      (CALIBRATE_RANGE >> CALIBRATE_SHIFT)
+#define CALIBRATE_CUTOFF    0.001
+#define CALIBRATE_MIN_SAMPLES 200
+
+/* the share of the range the synaptics driver puts outside the edges */
+#define EDGE_INSET_X        0.04
+#define EDGE_INSET_Y        0.055
+
+class EdgeCalibrator {
+public:
+    EdgeCalibrator();
+
+    void reset();
+    /* the device coordinates taken as 0; resets the samples */
+    void set_origin(int x, int y);
+    /* motion events with both coordinates and, if reported, pressure */
+    void add(const TraceEvent& event);
+    /* the kernel: n samples of x and y relative to the origin, clamped to
+     * CALIBRATE_RANGE; n need not be a multiple of 4 */
+    void add_block(const int* x, const int* y, unsigned n);
+    /* reduces the samples of a partial block */
+    void flush();
+
+    unsigned long samples() const;
+    /* motion events add() dropped for falling outside the range */
+    unsigned long outside() const;
+    /* in device coordinates from here on:
+     * raw extremes of axis TRACE_X or TRACE_Y, 0 without samples */
+    int minimum(int axis) const;
+    int maximum(int axis) const;
+    /* coordinate below which fraction (0-1) of the samples of axis lie */
+    int percentile(int axis, double fraction) const;
+
+    /*
+     * LeftEdge, RightEdge, TopEdge and BottomEdge inset from the range
+     * found the way the synaptics driver derives its defaults from the
+     * hardware range, and AreaLeftEdge to AreaBottomEdge at the range
+     * itself. False with fewer than CALIBRATE_MIN_SAMPLES samples, or too
+     * many outside the range.
+     */
+    bool propose(param_values& values);
+
+private:
+    int block_x[CALIBRATE_BLOCK];
+    int block_y[CALIBRATE_BLOCK];
+    unsigned pending;
+    unsigned long count;
+    unsigned long dropped;
+    int origin[2];
+    int low[2];
+    int high[2];
+    unsigned long histogram[2][CALIBRATE_BINS];
+};
+
+#endif	/* _TOUCHPAD_CALIBRATE_H */
@@ -0,0 +1,268 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#include <X11/Xatom.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <map>
+
+#include "synaptics-properties.h"
+#include "touchpad_backend.h"
+
+#ifndef XATOM_FLOAT
+#define XATOM_FLOAT "FLOAT"
+#endif
+
+/*
+ * Every property of synaptics-properties.h as a freshly loaded driver
+ * reports it. Format 0 stands for FLOAT.
+ */
+static const struct {
+    const char *prop_name;
+    int format;
+    int nitems;
+    double values[8];
+} fake_defaults[] = {
+    {SYNAPTICS_PROP_EDGES,                      32, 4, {1632, 5312, 1575, 4281}},
+    {SYNAPTICS_PROP_FINGER,                     32, 3, {25, 30, 256}},
+    {SYNAPTICS_PROP_TAP_TIME,                   32, 1, {180}},
+    {SYNAPTICS_PROP_TAP_MOVE,                   32, 1, {221}},
+    {SYNAPTICS_PROP_TAP_DURATIONS,              32, 3, {180, 180, 100}},
+    {SYNAPTICS_PROP_TAP_FAST,                   8,  1, {0}},
+    {SYNAPTICS_PROP_MIDDLE_TIMEOUT,             32, 1, {75}},
+    {SYNAPTICS_PROP_TWOFINGER_PRESSURE,         32, 1, {282}},
+    {SYNAPTICS_PROP_TWOFINGER_WIDTH,            32, 1, {7}},
+    {SYNAPTICS_PROP_SCROLL_DISTANCE,            32, 2, {100, 100}},
+    {SYNAPTICS_PROP_SCROLL_EDGE,                8,  3, {1, 0, 0}},
+    {SYNAPTICS_PROP_SCROLL_TWOFINGER,           8,  2, {1, 0}},
+    {SYNAPTICS_PROP_SPEED,                      0,  4, {1.0, 1.75, 0.0375, 40.0}},
+    {SYNAPTICS_PROP_EDGEMOTION_PRESSURE,        32, 2, {29, 159}},
+    {SYNAPTICS_PROP_EDGEMOTION_SPEED,           32, 2, {1, 401}},
+    {SYNAPTICS_PROP_EDGEMOTION,                 8,  1, {0}},
+    {SYNAPTICS_PROP_BUTTONSCROLLING,            8,  2, {1, 1}},
+    {SYNAPTICS_PROP_BUTTONSCROLLING_REPEAT,     8,  2, {0, 0}},
+    {SYNAPTICS_PROP_BUTTONSCROLLING_TIME,       32, 1, {100}},
+    {SYNAPTICS_PROP_OFF,                        8,  1, {0}},
+    {SYNAPTICS_PROP_GUESTMOUSE,                 8,  1, {0}},
+    {SYNAPTICS_PROP_LOCKED_DRAGS,               8,  1, {0}},
+    {SYNAPTICS_PROP_LOCKED_DRAGS_TIMEOUT,       32, 1, {5000}},
+    {SYNAPTICS_PROP_TAP_ACTION,                 8,  7, {2, 3, 0, 0, 1, 3, 0}},
+    {SYNAPTICS_PROP_CLICK_ACTION,               8,  3, {1, 1, 0}},
+    {SYNAPTICS_PROP_CIRCULAR_SCROLLING,         8,  1, {0}},
+    {SYNAPTICS_PROP_CIRCULAR_SCROLLING_DIST,    0,  1, {0.1}},
+    {SYNAPTICS_PROP_CIRCULAR_SCROLLING_TRIGGER, 8,  1, {0}},
+    {SYNAPTICS_PROP_CIRCULAR_PAD,               8,  1, {0}},
+    {SYNAPTICS_PROP_PALM_DETECT,                8,  1, {0}},
+    {SYNAPTICS_PROP_PALM_DIMENSIONS,            32, 2, {10, 200}},
+    {SYNAPTICS_PROP_COASTING_SPEED,             0,  1, {20.0}},
+    {SYNAPTICS_PROP_PRESSURE_MOTION,            32, 2, {30, 160}},
+    {SYNAPTICS_PROP_PRESSURE_MOTION_FACTOR,     0,  2, {1.0, 1.0}},
+    {SYNAPTICS_PROP_GRAB,                       8,  1, {1}},
+    {SYNAPTICS_PROP_GESTURES,                   8,  1, {1}},
+    {SYNAPTICS_PROP_CAPABILITIES,               8,  7, {1, 0, 0, 1, 1, 1, 1}},
+    {SYNAPTICS_PROP_RESOLUTION,                 32, 2, {1, 1}},
+    {SYNAPTICS_PROP_AREA,                       32, 4, {0, 0, 0, 0}},
+    {NULL, 0, 0, {0}}
+};
+
+/* interned names, the atom of a name is its index + 1 */
+static std::vector<std::string> fake_atom_names;
+/* the device, kept across backend instances like a real server would */
+static std::map<Atom, PropertyData> fake_properties;
+static FakeDeviceCounters fake_counters;
+static double fake_latency = -1;    /* ms, -1 until read from the environment */
+
+static Atom
+fake_intern(const char *name)
+{
+    for (size_t j = 0; j < fake_atom_names.size(); j++)
+        if (fake_atom_names[j] == name)
+            return j + 1;
+    fake_atom_names.push_back(name);
+    return fake_atom_names.size();
+}
+
+/*
+ * Accounts a request and, when it needs a reply, waits the configured
+ * latency like a client blocked on the server would.
+ */
+static void
+fake_request(unsigned long requests, bool reply)
+{
+    fake_counters.requests += requests;
+    if (!reply)
+        return;
+
+    fake_counters.round_trips++;
+    if (fake_latency < 0) {
+        const char* env = getenv("KCM_TOUCHPAD_FAKE_LATENCY");
+        fake_latency = env ? atof(env) : 0;
+    }
+    if (fake_latency > 0)
+        usleep((useconds_t)(fake_latency * 1000));
+}
+
+static void
+fake_populate()
+{
+    Atom float_type = fake_intern(XATOM_FLOAT);
+
+    fake_properties.clear();
+    for (int j = 0; fake_defaults[j].prop_name; j++) {
+        PropertyData& prop = fake_properties[fake_intern(fake_defaults[j].prop_name)];
+        prop.type = fake_defaults[j].format ? XA_INTEGER : float_type;
+        prop.format = fake_defaults[j].format ? fake_defaults[j].format : 32;
+        prop.items.resize(fake_defaults[j].nitems);
+        for (int k = 0; k < fake_defaults[j].nitems; k++) {
+            if (fake_defaults[j].format) {
+                prop.items[k] = (long)fake_defaults[j].values[k];
+            } else {
+                union { long l; float f; } v;
+                v.l = 0;
+                v.f = fake_defaults[j].values[k];
+                prop.items[k] = v.l;
+            }
+        }
+    }
+}
+
+/*
+ * Property I/O served from memory. Fetches model a pipelining client:
+ * a batch costs one round trip. Changes are one-way requests, as in X.
+ */
+class FakeBackend : public PropertyBackend
+{
+public:
+    FakeBackend()
+    {
+        if (fake_properties.empty())
+            fake_populate();
+    }
+
+    const char* name() const { return "fake"; }
+
+    void get_properties(const std::vector<Atom>& props,
+                        const std::vector<long>& lengths,
+                        std::vector<PropertyData>& out)
+    {
+        double start = xstats_start();
+        fake_request(props.size(), true);
+        xstats_request(props.size(), 24 * props.size());
+
+        unsigned long received = 0;
+        out.assign(props.size(), PropertyData());
+        for (size_t j = 0; j < props.size(); j++) {
+            std::map<Atom, PropertyData>::const_iterator it = fake_properties.find(props[j]);
+            if (it == fake_properties.end())
+                continue;
+
+            /* like XGetDeviceProperty, return no more than asked for */
+            size_t max = lengths[j] * 4 / (it->second.format / 8);
+            out[j] = it->second;
+            if (out[j].items.size() > max)
+                out[j].items.resize(max);
+            received += xstats_pad(out[j].items.size() * out[j].format / 8);
+        }
+        xstats_reply(start, 32 * props.size() + received);
+    }
+
+    void change_properties(const std::vector<Atom>& props,
+                           const std::vector<PropertyData>& data)
+    {
+        fake_request(props.size(), false);
+
+        for (size_t j = 0; j < props.size(); j++) {
+            xstats_request(1, 20 + xstats_pad(data[j].items.size() * data[j].format / 8));
+            std::map<Atom, PropertyData>::iterator it = fake_properties.find(props[j]);
+            /* the driver refuses to change a property's layout */
+            if (it == fake_properties.end() || it->second.type != data[j].type
+                || it->second.format != data[j].format
+                || it->second.items.size() != data[j].items.size()) {
+                fprintf(stderr, "Fake device: bad change of atom %lu.\n", props[j]);
+                continue;
+            }
+            it->second.items = data[j].items;
+        }
+    }
+};
+
+PropertyBackend*
+create_fake_backend()
+{
+    return new FakeBackend;
+}
+
+void
+fake_intern_atoms(char **names, int count, Atom *atoms)
+{
+    double start = xstats_start();
+    fake_request(count, true);
+
+    for (int j = 0; j < count; j++) {
+        xstats_request(1, 8 + xstats_pad(strlen(names[j])));
+        bool known = !strcmp(names[j], XATOM_FLOAT) || !strcmp(names[j], XI_TOUCHPAD);
+        for (int k = 0; !known && fake_defaults[k].prop_name; k++)
+            known = !strcmp(names[j], fake_defaults[k].prop_name);
+        /* only-if-exists, as the real code asks for */
+        atoms[j] = known ? fake_intern(names[j]) : None;
+    }
+    xstats_reply(start, 32 * count);
+}
+
+const char*
+fake_device_name()
+{
+    static const char name[] = "Fake SynPS/2 Synaptics TouchPad";
+
+    /* XListInputDevices */
+    double start = xstats_start();
+    fake_request(1, true);
+    xstats_request(1, 4);
+    xstats_reply(start, 32 + xstats_pad(8 + sizeof(name)));
+    return name;
+}
+
+void
+fake_device_reset()
+{
+    fake_populate();
+    fake_counters = FakeDeviceCounters();
+}
+
+FakeDeviceCounters
+fake_device_counters()
+{
+    return fake_counters;
+}
+
+void
+fake_device_set_latency(double ms)
+{
+    fake_latency = ms;
+}
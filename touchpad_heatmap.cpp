@@ -0,0 +1,137 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#include <string.h>
+
+#include "touchpad_heatmap.h"
+#include "touchpad_calibrate.h"
+
+TouchHeatmap::TouchHeatmap()
+    : total(0), origin_x(0), origin_y(0), scale_x(0), scale_y(0), nchanged(0)
+{
+    memset(counts, 0, sizeof(counts));
+    memset(listed, 0, sizeof(listed));
+    /* until the edges are known, the driver's for a 1472-5472 x
+     * 1408-4448 touchpad */
+    set_edges(1632, 5312, 1575, 4281);
+}
+
+void
+TouchHeatmap::set_edges(int left, int right, int top, int bottom)
+{
+    if (right <= left || bottom <= top)
+        return;
+
+    /* the edges are inset from the range by a share of the range */
+    double width = (right - left) / (1 - 2 * EDGE_INSET_X);
+    double height = (bottom - top) / (1 - 2 * EDGE_INSET_Y);
+    int x = left - (int)(width * EDGE_INSET_X);
+    int y = top - (int)(height * EDGE_INSET_Y);
+    long sx = (long)(HEATMAP_COLUMNS * 65536.0 / width);
+    long sy = (long)(HEATMAP_ROWS * 65536.0 / height);
+    if (x == origin_x && y == origin_y && sx == scale_x && sy == scale_y)
+        return;
+
+    origin_x = x;
+    origin_y = y;
+    scale_x = sx;
+    scale_y = sy;
+    reset();
+}
+
+void
+TouchHeatmap::reset()
+{
+    for (unsigned cell = 0; cell < HEATMAP_CELLS; cell++) {
+        if (counts[cell]) {
+            counts[cell] = 0;
+            mark(cell);
+        }
+    }
+    total = 0;
+}
+
+void
+TouchHeatmap::add(const TraceEvent& event)
+{
+    if (event.type != TRACE_MOTION)
+        return;
+    if (event.values[TRACE_X] == TRACE_NONE || event.values[TRACE_Y] == TRACE_NONE)
+        return;
+    if (event.values[TRACE_PRESSURE] != TRACE_NONE && event.values[TRACE_PRESSURE] <= 0)
+        return;
+
+    /* touches off the grid count at its border */
+    long column = ((long)(event.values[TRACE_X] - origin_x) * scale_x) >> 16;
+    long row = ((long)(event.values[TRACE_Y] - origin_y) * scale_y) >> 16;
+    if (column < 0)
+        column = 0;
+    else if (column >= HEATMAP_COLUMNS)
+        column = HEATMAP_COLUMNS - 1;
+    if (row < 0)
+        row = 0;
+    else if (row >= HEATMAP_ROWS)
+        row = HEATMAP_ROWS - 1;
+
+    unsigned cell = row * HEATMAP_COLUMNS + column;
+    counts[cell]++;
+    total++;
+    mark(cell);
+}
+
+void
+TouchHeatmap::mark(unsigned cell)
+{
+    if (listed[cell])
+        return;
+    listed[cell] = 1;
+    changed[nchanged++] = cell;
+}
+
+unsigned long
+TouchHeatmap::count(unsigned cell) const
+{
+    return cell < HEATMAP_CELLS ? counts[cell] : 0;
+}
+
+unsigned long
+TouchHeatmap::touches() const
+{
+    return total;
+}
+
+unsigned
+TouchHeatmap::take_changes(unsigned* cells, unsigned max)
+{
+    unsigned n = nchanged < max ? nchanged : max;
+    for (unsigned k = 0; k < n; k++) {
+        cells[k] = changed[k];
+        listed[changed[k]] = 0;
+    }
+    /* the rest stays listed for the next call */
+    memmove(changed, changed + n, (nchanged - n) * sizeof(changed[0]));
+    nchanged -= n;
+    return n;
+}
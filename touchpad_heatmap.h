@@ -0,0 +1,77 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#ifndef _TOUCHPAD_HEATMAP_H
+#define	_TOUCHPAD_HEATMAP_H
+
+#include "touchpad_trace.h"
+
+/*
+ * Counts where the finger touches the touchpad, in a grid of
+ * HEATMAP_COLUMNS x HEATMAP_ROWS cells (row by row) over the whole
+ * touchpad: its edges (LeftEdge etc.) with the margins the synaptics
+ * driver leaves outside them, so the edges always lie EDGE_INSET_X and
+ * EDGE_INSET_Y of the width and height in.
+ * Memory is fixed and an event costs a multiplication per axis. Cells
+ * which changed are listed for take_changes(), so a view only needs to
+ * repaint those.
+ */
+#define HEATMAP_COLUMNS     64
+#define HEATMAP_ROWS        40
+#define HEATMAP_CELLS       (HEATMAP_COLUMNS * HEATMAP_ROWS)
+
+class TouchHeatmap {
+public:
+    TouchHeatmap();
+
+    /* moves the grid, which empties it unless the edges are the same */
+    void set_edges(int left, int right, int top, int bottom);
+    /* every counted cell shows up as changed to 0 */
+    void reset();
+    /* motion events with both coordinates and, if reported, pressure */
+    void add(const TraceEvent& event);
+
+    unsigned long count(unsigned cell) const;
+    unsigned long touches() const;
+
+    /*
+     * Fills cells with the indices of up to max cells changed since the
+     * last call and returns their number; those are no longer listed.
+     */
+    unsigned take_changes(unsigned* cells, unsigned max);
+
+private:
+    void mark(unsigned cell);
+
+    unsigned long counts[HEATMAP_CELLS];
+    unsigned long total;
+    int origin_x, origin_y;
+    long scale_x, scale_y;      /* cells per unit, 16.16 fixed point */
+    unsigned short changed[HEATMAP_CELLS];
+    unsigned nchanged;
+    unsigned char listed[HEATMAP_CELLS];
+};
+
+#endif	/* _TOUCHPAD_HEATMAP_H */
@@ -0,0 +1,169 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "touchpad_snapshot.h"
+
+static const char snapshot_magic[] = "SYNSNAP";
+static const int snapshot_version = 1;
+
+static void
+snapshot_put(std::string& out, unsigned long value, int bytes)
+{
+    for (int j = 0; j < bytes; j++)
+        out += (char)((value >> (8 * j)) & 0xff);
+}
+
+/* false past the end of the data */
+static bool
+snapshot_get(const std::string& in, size_t& pos, unsigned long* value, int bytes)
+{
+    if (in.size() - pos < (size_t)bytes)
+        return false;
+
+    *value = 0;
+    for (int j = 0; j < bytes; j++)
+        *value |= (unsigned long)(unsigned char)in[pos++] << (8 * j);
+    return true;
+}
+
+static bool
+snapshot_get_string(const std::string& in, size_t& pos, std::string& out, int length_bytes)
+{
+    unsigned long length;
+    if (!snapshot_get(in, pos, &length, length_bytes) || in.size() - pos < length)
+        return false;
+
+    out.assign(in, pos, length);
+    pos += length;
+    return true;
+}
+
+bool
+snapshot_read(const char* path, snapshot_devices& devices)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    /* read whole, it is small */
+    std::string in;
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        in.append(buffer, n);
+    fclose(file);
+
+    size_t pos = sizeof(snapshot_magic);
+    if (in.size() < pos || in.compare(0, pos - 1, snapshot_magic) ||
+        in[pos - 1] != snapshot_version) {
+        fprintf(stderr, "'%s' is no touchpad snapshot.\n", path);
+        return false;
+    }
+
+    unsigned long ndevices, nprops, value;
+    if (!snapshot_get(in, pos, &ndevices, 2))
+        goto damaged;
+
+    devices.clear();
+    for (unsigned long d = 0; d < ndevices; d++) {
+        std::string name;
+        if (!snapshot_get_string(in, pos, name, 2) || !snapshot_get(in, pos, &nprops, 2))
+            goto damaged;
+
+        snapshot_properties& props = devices[name];
+        props.resize(nprops);
+        for (unsigned long p = 0; p < nprops; p++) {
+            SnapshotProperty& prop = props[p];
+            unsigned long kind, format, nitems;
+            if (!snapshot_get_string(in, pos, prop.name, 1) ||
+                !snapshot_get(in, pos, &kind, 1) || !snapshot_get(in, pos, &format, 1) ||
+                (format != 8 && format != 16 && format != 32) ||
+                !snapshot_get(in, pos, &nitems, 2))
+                goto damaged;
+
+            prop.kind = kind;
+            prop.format = format;
+            prop.items.resize(nitems);
+            for (unsigned long j = 0; j < nitems; j++) {
+                if (!snapshot_get(in, pos, &value, format / 8))
+                    goto damaged;
+                /* items are signed like Xlib hands them out */
+                if (format == 8)
+                    prop.items[j] = (signed char)value;
+                else if (format == 16)
+                    prop.items[j] = (short)value;
+                else
+                    prop.items[j] = (int)value;
+            }
+        }
+    }
+    return true;
+
+damaged:
+    fprintf(stderr, "Touchpad snapshot '%s' is damaged.\n", path);
+    devices.clear();
+    return false;
+}
+
+bool
+snapshot_write(const char* path, const snapshot_devices& devices)
+{
+    std::string out(snapshot_magic);
+    out += (char)snapshot_version;
+    snapshot_put(out, devices.size(), 2);
+
+    for (snapshot_devices::const_iterator d = devices.begin(); d != devices.end(); ++d) {
+        snapshot_put(out, d->first.size(), 2);
+        out += d->first;
+        snapshot_put(out, d->second.size(), 2);
+
+        for (snapshot_properties::const_iterator p = d->second.begin(); p != d->second.end(); ++p) {
+            snapshot_put(out, p->name.size(), 1);
+            out += p->name;
+            snapshot_put(out, p->kind, 1);
+            snapshot_put(out, p->format, 1);
+            snapshot_put(out, p->items.size(), 2);
+            for (size_t j = 0; j < p->items.size(); j++)
+                snapshot_put(out, p->items[j], p->format / 8);
+        }
+    }
+
+    std::string temporary = std::string(path) + ".new";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "Cannot create touchpad snapshot '%s'.\n", temporary.c_str());
+        return false;
+    }
+    bool written = fwrite(out.data(), 1, out.size(), file) == out.size();
+    if (fclose(file) || !written || rename(temporary.c_str(), path)) {
+        fprintf(stderr, "Cannot write touchpad snapshot '%s'.\n", path);
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
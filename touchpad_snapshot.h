@@ -0,0 +1,67 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#ifndef _TOUCHPAD_SNAPSHOT_H
+#define	_TOUCHPAD_SNAPSHOT_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * Raw contents of the synaptics properties of touchpads, by device name,
+ * as saved by Touchpad::save_snapshot(). Items are stored one per long
+ * like in PropertyData; floats keep their bit pattern.
+ */
+enum SnapshotKind {
+    SNAPSHOT_INTEGER,
+    SNAPSHOT_FLOAT
+};
+
+struct SnapshotProperty {
+    std::string name;
+    int kind;                   /* SnapshotKind */
+    int format;                 /* 8, 16 or 32 */
+    std::vector<long> items;
+};
+
+typedef std::vector<SnapshotProperty> snapshot_properties;
+typedef std::map<std::string, snapshot_properties> snapshot_devices;
+
+/*
+ * Snapshot file layout, numbers little endian:
+ *   "SYNSNAP", version byte (1), device count (16 bits)
+ * per device:
+ *   name length (16 bits) and bytes, property count (16 bits)
+ * per property:
+ *   name length (8 bits) and bytes, kind, format (8 bits each),
+ *   item count (16 bits), then the items in format / 8 bytes each
+ * A touchpad takes about 1 KB.
+ */
+bool snapshot_read(const char* path, snapshot_devices& devices);
+/* replaces the file only once it is complete */
+bool snapshot_write(const char* path, const snapshot_devices& devices);
+
+#endif	/* _TOUCHPAD_SNAPSHOT_H */
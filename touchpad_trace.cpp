@@ -0,0 +1,424 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "touchpad_trace.h"
+
+static const char trace_magic[] = "SYNTRACE";
+static const int trace_version = 1;
+
+TraceRing::TraceRing(unsigned capacity)
+    : head(0), tail(0), lost(0)
+{
+    unsigned size = 2;
+    while (size < capacity)
+        size <<= 1;
+    events = new TraceEvent[size];
+    mask = size - 1;
+}
+
+TraceRing::~TraceRing()
+{
+    delete[] events;
+}
+
+unsigned
+TraceRing::size() const
+{
+    return head - tail;
+}
+
+unsigned
+TraceRing::capacity() const
+{
+    return mask + 1;
+}
+
+bool
+TraceRing::put(const TraceEvent& event)
+{
+    unsigned h = head;
+    if (h - tail > mask)
+        return false;
+
+    events[h & mask] = event;
+    /* the slot must be complete before the consumer can see it */
+    __sync_synchronize();
+    head = h + 1;
+    return true;
+}
+
+bool
+TraceRing::push(const TraceEvent& event)
+{
+    if (lost) {
+        /* the gap goes in only together with the event after it */
+        if (head - tail > mask - 1) {
+            lost++;
+            return false;
+        }
+
+        TraceEvent gap;
+        memset(&gap, 0, sizeof(gap));
+        gap.time = event.time;
+        gap.type = TRACE_GAP;
+        gap.button = lost;
+        put(gap);
+        lost = 0;
+    }
+
+    if (!put(event)) {
+        lost++;
+        return false;
+    }
+    return true;
+}
+
+bool
+TraceRing::pop(TraceEvent& event)
+{
+    unsigned t = tail;
+    if (t == head)
+        return false;
+
+    /* read the slot only after seeing head move past it */
+    __sync_synchronize();
+    event = events[t & mask];
+    __sync_synchronize();
+    tail = t + 1;
+    return true;
+}
+
+static void
+trace_put_varint(FILE* file, unsigned long value)
+{
+    while (value >= 0x80) {
+        putc((int)(value & 0x7f) | 0x80, file);
+        value >>= 7;
+    }
+    putc((int)value, file);
+}
+
+/* 1 on success, 0 at the end of the file before the first byte, -1 inside */
+static int
+trace_get_varint(FILE* file, unsigned long* value)
+{
+    int shift = 0;
+    int c;
+
+    *value = 0;
+    while ((c = getc(file)) != EOF) {
+        if (shift > 63)
+            return -1;
+        *value |= (unsigned long)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return 1;
+        shift += 7;
+    }
+    return shift ? -1 : 0;
+}
+
+/* small differences of either sign become small numbers */
+static unsigned long
+trace_zigzag(long value)
+{
+    return value < 0 ? ((unsigned long)(-(value + 1)) << 1) | 1 : (unsigned long)value << 1;
+}
+
+static long
+trace_unzigzag(unsigned long value)
+{
+    return value & 1 ? -(long)(value >> 1) - 1 : (long)(value >> 1);
+}
+
+TraceWriter::TraceWriter()
+    : file(NULL), valuators(0)
+{
+}
+
+TraceWriter::~TraceWriter()
+{
+    close();
+}
+
+bool
+TraceWriter::open(const char* path, const char* device, int valuators)
+{
+    close();
+    file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Cannot create trace file '%s'.\n", path);
+        return false;
+    }
+
+    this->valuators = valuators;
+    memset(&last, 0, sizeof(last));
+
+    size_t length = device ? strlen(device) : 0;
+    fwrite(trace_magic, 1, sizeof(trace_magic) - 1, file);
+    putc(trace_version, file);
+    putc(valuators, file);
+    trace_put_varint(file, length);
+    fwrite(device, 1, length, file);
+    return true;
+}
+
+void
+TraceWriter::write(const TraceEvent& event)
+{
+    if (!file)
+        return;
+
+    int tag = event.type & 3;
+    for (int v = 0; v < TRACE_VALUATORS; v++)
+        if ((valuators & (1 << v)) && event.values[v] != last.values[v])
+            tag |= 4 << v;
+
+    putc(tag, file);
+    /* server time is 32 bits wide and wraps */
+    trace_put_varint(file, (event.time - last.time) & 0xffffffffUL);
+    for (int v = 0; v < TRACE_VALUATORS; v++)
+        if (tag & (4 << v))
+            trace_put_varint(file, trace_zigzag((long)event.values[v] - last.values[v]));
+    if (event.type != TRACE_MOTION)
+        trace_put_varint(file, event.button);
+
+    last.time = event.time;
+    for (int v = 0; v < TRACE_VALUATORS; v++)
+        if (tag & (4 << v))
+            last.values[v] = event.values[v];
+}
+
+void
+TraceWriter::flush()
+{
+    if (file)
+        fflush(file);
+}
+
+void
+TraceWriter::close()
+{
+    if (file)
+        fclose(file);
+    file = NULL;
+}
+
+TraceReader::TraceReader()
+    : file(NULL), name(NULL), present(0)
+{
+}
+
+TraceReader::~TraceReader()
+{
+    close();
+}
+
+bool
+TraceReader::open(const char* path)
+{
+    char magic[sizeof(trace_magic) - 1];
+    unsigned long length;
+
+    close();
+    file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, trace_magic, sizeof(magic)) ||
+        getc(file) != trace_version ||
+        (present = getc(file)) == EOF ||
+        trace_get_varint(file, &length) != 1 || length > 4096) {
+        fprintf(stderr, "'%s' is not a touchpad trace.\n", path);
+        close();
+        return false;
+    }
+
+    name = (char*)malloc(length + 1);
+    if (fread(name, 1, length, file) != length) {
+        close();
+        return false;
+    }
+    name[length] = '\0';
+
+    memset(&last, 0, sizeof(last));
+    return true;
+}
+
+void
+TraceReader::close()
+{
+    if (file)
+        fclose(file);
+    file = NULL;
+    free(name);
+    name = NULL;
+    present = 0;
+}
+
+const char*
+TraceReader::device() const
+{
+    return name;
+}
+
+int
+TraceReader::valuators() const
+{
+    return present;
+}
+
+int
+TraceReader::next(TraceEvent& event)
+{
+    unsigned long value;
+    int tag;
+
+    if (!file || (tag = getc(file)) == EOF)
+        return 0;
+
+    if (trace_get_varint(file, &value) != 1)
+        return -1;
+    last.time += value;
+    last.type = tag & 3;
+    last.button = 0;
+
+    for (int v = 0; v < TRACE_VALUATORS; v++) {
+        if (!(tag & (4 << v)))
+            continue;
+        if (trace_get_varint(file, &value) != 1)
+            return -1;
+        last.values[v] += trace_unzigzag(value);
+    }
+    if (last.type != TRACE_MOTION) {
+        if (trace_get_varint(file, &value) != 1)
+            return -1;
+        last.button = value;
+    }
+
+    event = last;
+    for (int v = 0; v < TRACE_VALUATORS; v++)
+        if (!(present & (1 << v)))
+            event.values[v] = TRACE_NONE;
+    return 1;
+}
+
+TapLatency::TapLatency()
+    : finger_low(25), finger_high(30)
+{
+    reset();
+}
+
+void
+TapLatency::set_thresholds(int finger_low, int finger_high)
+{
+    this->finger_low = finger_low;
+    this->finger_high = finger_high;
+}
+
+void
+TapLatency::reset()
+{
+    count = 0;
+    touching = false;
+    waiting = false;
+    left = 0;
+    guessed = false;
+}
+
+void
+TapLatency::add(const TraceEvent& event)
+{
+    int pressure = event.values[TRACE_PRESSURE];
+
+    switch (event.type) {
+    case TRACE_GAP:
+        /* the finger may have come and gone meanwhile */
+        touching = false;
+        waiting = false;
+        break;
+
+    case TRACE_MOTION:
+        if (pressure == TRACE_NONE) {
+            waiting = true;
+            left = event.time;
+        } else if (!touching && pressure >= finger_high) {
+            touching = true;
+            waiting = false;
+        } else if (touching && pressure < finger_low) {
+            touching = false;
+            waiting = true;
+            left = event.time;
+        }
+        break;
+
+    case TRACE_BUTTON_PRESS:
+        /* a press of a finger still down is a real click */
+        if (waiting && !touching && event.time >= left &&
+            event.time - left <= TAP_LATENCY_MAX) {
+            delays[count % TAP_LATENCY_SAMPLES] = event.time - left;
+            count++;
+            if (pressure == TRACE_NONE)
+                guessed = true;
+        }
+        waiting = false;
+        break;
+    }
+}
+
+unsigned
+TapLatency::taps() const
+{
+    return count < TAP_LATENCY_SAMPLES ? count : TAP_LATENCY_SAMPLES;
+}
+
+double
+TapLatency::percentile(double fraction) const
+{
+    unsigned n = taps();
+    if (!n)
+        return -1;
+
+    /* nearest rank */
+    unsigned long sorted[TAP_LATENCY_SAMPLES];
+    std::copy(delays, delays + n, sorted);
+    unsigned rank = (unsigned)(fraction * n + 0.999999);
+    rank = rank ? rank - 1 : 0;
+    if (rank >= n)
+        rank = n - 1;
+    std::nth_element(sorted, sorted + rank, sorted + n);
+    return sorted[rank];
+}
+
+bool
+TapLatency::estimated() const
+{
+    return guessed;
+}
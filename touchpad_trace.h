@@ -0,0 +1,183 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#ifndef _TOUCHPAD_TRACE_H
+#define	_TOUCHPAD_TRACE_H
+
+#include <stdio.h>
+
+/*
+ * Raw events of one touchpad, as recorded by Touchpad::start_trace().
+ * Valuators the device does not report read as TRACE_NONE.
+ */
+#define TRACE_NONE (-2147483647 - 1)
+
+enum TraceEventType {
+    TRACE_MOTION,
+    TRACE_BUTTON_PRESS,
+    TRACE_BUTTON_RELEASE,
+    TRACE_GAP                   /* events lost to a full ring, count in button */
+};
+
+enum TraceValuator {
+    TRACE_X,
+    TRACE_Y,
+    TRACE_PRESSURE,
+    TRACE_WIDTH,
+    TRACE_VALUATORS
+};
+
+struct TraceEvent {
+    unsigned long time;         /* X server time, ms */
+    int type;                   /* TraceEventType */
+    int button;                 /* button events only */
+    int values[TRACE_VALUATORS];
+};
+
+/*
+ * Fixed size ring of events between one producer and one consumer.
+ * Neither side locks, blocks or allocates. The ring of the Touchpad
+ * namespace is filled and drained on the thread calling process_events(),
+ * which also flushes it when it fills up (see Touchpad::start_trace()).
+ * When the ring is full the producer drops events and, once there is room
+ * again, queues a TRACE_GAP event with their count ahead of the next one.
+ */
+class TraceRing {
+public:
+    /* rounded up to a power of two */
+    TraceRing(unsigned capacity);
+    ~TraceRing();
+
+    bool push(const TraceEvent& event);
+    bool pop(TraceEvent& event);
+    unsigned size() const;
+    unsigned capacity() const;
+
+private:
+    TraceRing(const TraceRing&);
+    TraceRing& operator=(const TraceRing&);
+
+    bool put(const TraceEvent& event);
+
+    TraceEvent* events;
+    unsigned mask;
+    volatile unsigned head;     /* next slot to fill, producer only */
+    volatile unsigned tail;     /* next slot to read, consumer only */
+    unsigned long lost;         /* producer only */
+};
+
+/*
+ * Trace file layout, all numbers unsigned LEB128 varints:
+ *   "SYNTRACE", version byte (1), valuator byte (bit v set when valuator v
+ *   is reported), device name length and bytes,
+ * then one record per event:
+ *   tag byte: event type in bits 0-1, bit 2 + v set when valuator v changed
+ *   milliseconds since the previous event (since 0 for the first)
+ *   for each changed valuator, the zigzag encoded difference to its last
+ *   value (0 before the first event)
+ *   the button of button events, the lost count of gaps
+ * A motion event changing one coordinate by a few units takes 3 bytes.
+ */
+class TraceWriter {
+public:
+    TraceWriter();
+    ~TraceWriter();
+
+    /* valuators: bit v set when valuator v is reported */
+    bool open(const char* path, const char* device, int valuators);
+    void write(const TraceEvent& event);
+    /* hands buffered records to the kernel */
+    void flush();
+    void close();
+
+private:
+    FILE* file;
+    TraceEvent last;
+    int valuators;
+};
+
+class TraceReader {
+public:
+    TraceReader();
+    ~TraceReader();
+
+    bool open(const char* path);
+    void close();
+
+    const char* device() const;
+    int valuators() const;
+
+    /* 1 with an event, 0 at the end, -1 when the file is damaged */
+    int next(TraceEvent& event);
+
+private:
+    FILE* file;
+    char* name;
+    TraceEvent last;
+    int present;
+};
+
+/*
+ * Delays between taps and the clicks the driver makes of them, worked out
+ * from the events of one device. The finger touches when its pressure
+ * reaches finger_high and leaves when it drops below finger_low, as the
+ * driver decides it (FingerHigh, FingerLow); the first button press after
+ * the finger left, before it touches again, is the click of the tap, and
+ * the delay is the time in between.
+ * Without pressure the finger is taken to leave with the last motion event
+ * before the press, which also counts clicks of a finger resting still;
+ * those delays are only estimates.
+ * The latest TAP_LATENCY_SAMPLES delays are kept.
+ */
+#define TAP_LATENCY_SAMPLES 256
+#define TAP_LATENCY_MAX     1000    /* ms, longer waits are no tap's click */
+
+class TapLatency {
+public:
+    TapLatency();
+
+    void set_thresholds(int finger_low, int finger_high);
+    void reset();
+    void add(const TraceEvent& event);
+
+    /* delays kept */
+    unsigned taps() const;
+    /* ms below which fraction (0-1) of the kept delays lie, -1 without any */
+    double percentile(double fraction) const;
+    /* true once delays were measured without pressure */
+    bool estimated() const;
+
+private:
+    unsigned long delays[TAP_LATENCY_SAMPLES];
+    unsigned long count;        /* all delays measured */
+    int finger_low;
+    int finger_high;
+    bool touching;
+    bool waiting;               /* the finger left, no click yet */
+    unsigned long left;         /* when it did */
+    bool guessed;
+};
+
+#endif	/* _TOUCHPAD_TRACE_H */
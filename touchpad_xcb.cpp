@@ -0,0 +1,154 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+#include <xcb/xinput.h>
+
+#include <stdlib.h>
+
+#include "touchpad_backend.h"
+
+/*
+ * xcb-xinput implementation sharing the Xlib connection. All requests of
+ * a batch are sent before the first reply is awaited, so a whole load or
+ * apply costs a single round trip.
+ */
+class XcbBackend : public PropertyBackend
+{
+public:
+    XcbBackend(Display* dpy, XDevice* dev)
+        : conn(XGetXCBConnection(dpy)), device_id(dev->device_id) {}
+
+    const char* name() const { return "xcb"; }
+
+    void get_properties(const std::vector<Atom>& props,
+                        const std::vector<long>& lengths,
+                        std::vector<PropertyData>& out)
+    {
+        std::vector<xcb_input_get_device_property_cookie_t> cookies(props.size());
+
+        out.assign(props.size(), PropertyData());
+
+        double start = xstats_start();
+        unsigned long received = 0;
+        for (size_t j = 0; j < props.size(); j++)
+            cookies[j] = xcb_input_get_device_property(conn, props[j],
+                                                       XCB_ATOM_ANY, 0, lengths[j],
+                                                       device_id, 0);
+        xstats_request(props.size(), 24 * props.size());
+
+        for (size_t j = 0; j < props.size(); j++) {
+            xcb_input_get_device_property_reply_t* reply =
+                xcb_input_get_device_property_reply(conn, cookies[j], NULL);
+            if (!reply)
+                continue;
+            received += 32 + xstats_pad(reply->num_items * reply->format / 8);
+
+            if (reply->type != XCB_ATOM_NONE) {
+                xcb_input_get_device_property_items_t items;
+                xcb_input_get_device_property_items_unpack(
+                    xcb_input_get_device_property_items(reply),
+                    reply->num_items, reply->format, &items);
+
+                out[j].type = reply->type;
+                out[j].format = reply->format;
+                out[j].items.resize(reply->num_items);
+                for (uint32_t i = 0; i < reply->num_items; i++) {
+                    switch (reply->format) {
+                        case 8:
+                            out[j].items[i] = (char)items.data8[i];
+                            break;
+                        case 16:
+                            out[j].items[i] = (short)items.data16[i];
+                            break;
+                        default:
+                            /* sign extended like Xlib does for format 32 */
+                            out[j].items[i] = (int32_t)items.data32[i];
+                            break;
+                    }
+                }
+            }
+            free(reply);
+        }
+        /* pipelined, the whole batch waits for a single round trip */
+        if (!props.empty())
+            xstats_reply(start, received);
+    }
+
+    void change_properties(const std::vector<Atom>& props,
+                           const std::vector<PropertyData>& data)
+    {
+        for (size_t j = 0; j < props.size(); j++) {
+            const PropertyData& d = data[j];
+            size_t n = d.items.size();
+
+            if (!n)
+                continue;
+
+            xstats_request(1, 20 + xstats_pad(n * d.format / 8));
+            switch (d.format) {
+                case 8:
+                {
+                    std::vector<uint8_t> b(n);
+                    for (size_t i = 0; i < n; i++)
+                        b[i] = d.items[i];
+                    xcb_input_change_device_property(conn, props[j], d.type, device_id,
+                                                     8, XCB_PROP_MODE_REPLACE, n, &b[0]);
+                    break;
+                }
+                case 16:
+                {
+                    std::vector<uint16_t> s(n);
+                    for (size_t i = 0; i < n; i++)
+                        s[i] = d.items[i];
+                    xcb_input_change_device_property(conn, props[j], d.type, device_id,
+                                                     16, XCB_PROP_MODE_REPLACE, n, &s[0]);
+                    break;
+                }
+                default:
+                {
+                    std::vector<uint32_t> l(n);
+                    for (size_t i = 0; i < n; i++)
+                        l[i] = d.items[i];
+                    xcb_input_change_device_property(conn, props[j], d.type, device_id,
+                                                     32, XCB_PROP_MODE_REPLACE, n, &l[0]);
+                    break;
+                }
+            }
+        }
+        xcb_flush(conn);
+    }
+
+private:
+    xcb_connection_t* conn;
+    uint8_t device_id;
+};
+
+PropertyBackend*
+create_xcb_backend(Display* dpy, XDevice* dev)
+{
+    return new XcbBackend(dpy, dev);
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#include <X11/Xatom.h>
+
+#include "touchpad_backend.h"
+
+/*
+ * Plain Xlib implementation, one synchronous round trip per fetched
+ * property.
+ */
+class XlibBackend : public PropertyBackend
+{
+public:
+    XlibBackend(Display* dpy, XDevice* dev) : dpy(dpy), dev(dev) {}
+
+    const char* name() const { return "xlib"; }
+
+    void get_properties(const std::vector<Atom>& props,
+                        const std::vector<long>& lengths,
+                        std::vector<PropertyData>& out)
+    {
+        out.assign(props.size(), PropertyData());
+
+        for (size_t j = 0; j < props.size(); j++) {
+            Atom type;
+            int format;
+            unsigned long nitems, bytes_after;
+            unsigned char* data = NULL;
+
+            double start = xstats_start();
+            Status status = XGetDeviceProperty(dpy, dev, props[j], 0, lengths[j], False,
+                                               AnyPropertyType, &type, &format,
+                                               &nitems, &bytes_after, &data);
+            xstats_request(1, 24);
+            xstats_reply(start, 32 + (status == Success ? xstats_pad(nitems * format / 8) : 0));
+            if (status != Success)
+                continue;
+
+            if (data && type != None) {
+                out[j].type = type;
+                out[j].format = format;
+                out[j].items.resize(nitems);
+                for (unsigned long i = 0; i < nitems; i++) {
+                    switch (format) {
+                        case 8:
+                            out[j].items[i] = ((char*)data)[i];
+                            break;
+                        case 16:
+                            out[j].items[i] = ((short*)data)[i];
+                            break;
+                        default:
+                            out[j].items[i] = ((long*)data)[i];
+                            break;
+                    }
+                }
+            }
+            if (data)
+                XFree(data);
+        }
+    }
+
+    void change_properties(const std::vector<Atom>& props,
+                           const std::vector<PropertyData>& data)
+    {
+        for (size_t j = 0; j < props.size(); j++) {
+            const PropertyData& d = data[j];
+            size_t n = d.items.size();
+
+            if (!n)
+                continue;
+
+            xstats_request(1, 20 + xstats_pad(n * d.format / 8));
+            switch (d.format) {
+                case 8:
+                {
+                    std::vector<char> b(n);
+                    for (size_t i = 0; i < n; i++)
+                        b[i] = d.items[i];
+                    XChangeDeviceProperty(dpy, dev, props[j], d.type, 8,
+                                          PropModeReplace, (unsigned char*)&b[0], n);
+                    break;
+                }
+                case 16:
+                {
+                    std::vector<short> s(n);
+                    for (size_t i = 0; i < n; i++)
+                        s[i] = d.items[i];
+                    XChangeDeviceProperty(dpy, dev, props[j], d.type, 16,
+                                          PropModeReplace, (unsigned char*)&s[0], n);
+                    break;
+                }
+                default:
+                    XChangeDeviceProperty(dpy, dev, props[j], d.type, 32,
+                                          PropModeReplace, (unsigned char*)&d.items[0], n);
+                    break;
+            }
+        }
+        XFlush(dpy);
+    }
+
+private:
+    Display* dpy;
+    XDevice* dev;
+};
+
+PropertyBackend*
+create_xlib_backend(Display* dpy, XDevice* dev)
+{
+    return new XlibBackend(dpy, dev);
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "touchpad_backend.h"
+
+/* Traffic booked to one API entry point */
+struct XStats {
+    const char* entry;
+    unsigned long calls;
+    unsigned long requests;
+    unsigned long round_trips;
+    unsigned long bytes_out;
+    unsigned long bytes_in;
+    double blocked;     /* ms */
+};
+
+static int enabled = -1;
+static int depth = 0;
+static std::vector<XStats> stats;
+static XStats* current_stats = NULL;
+
+static double
+xstats_now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+static XStats*
+xstats_find(const char* entry)
+{
+    for (size_t j = 0; j < stats.size(); j++)
+        if (!strcmp(stats[j].entry, entry))
+            return &stats[j];
+
+    XStats s;
+    memset(&s, 0, sizeof(s));
+    s.entry = entry;
+    stats.push_back(s);
+    return &stats.back();
+}
+
+/* traffic outside of any entry point */
+static XStats*
+xstats_current()
+{
+    return current_stats ? current_stats : xstats_find("(other)");
+}
+
+bool
+xstats_enabled()
+{
+    if (enabled < 0) {
+        const char* env = getenv("KCM_TOUCHPAD_XSTATS");
+        enabled = env && *env && strcmp(env, "0");
+    }
+    return enabled;
+}
+
+void
+xstats_enter(const char* entry)
+{
+    if (!xstats_enabled() || depth++)
+        return;
+
+    current_stats = xstats_find(entry);
+    current_stats->calls++;
+}
+
+void
+xstats_leave()
+{
+    if (!xstats_enabled() || --depth)
+        return;
+
+    current_stats = NULL;
+}
+
+double
+xstats_start()
+{
+    return xstats_enabled() ? xstats_now() : 0;
+}
+
+void
+xstats_request(unsigned long requests, unsigned long bytes_out)
+{
+    if (!xstats_enabled())
+        return;
+
+    XStats* s = xstats_current();
+    s->requests += requests;
+    s->bytes_out += bytes_out;
+}
+
+void
+xstats_reply(double start, unsigned long bytes_in)
+{
+    if (!xstats_enabled())
+        return;
+
+    XStats* s = xstats_current();
+    s->round_trips++;
+    s->bytes_in += bytes_in;
+    s->blocked += xstats_now() - start;
+}
+
+void
+xstats_dump()
+{
+    if (!xstats_enabled() || stats.empty())
+        return;
+
+    XStats total;
+    memset(&total, 0, sizeof(total));
+
+    fprintf(stderr, "%-24s %6s %8s %6s %10s %10s %11s\n", "X traffic by call",
+            "calls", "requests", "trips", "bytes out", "bytes in", "blocked");
+    for (size_t j = 0; j < stats.size(); j++) {
+        const XStats& s = stats[j];
+        fprintf(stderr, "%-24s %6lu %8lu %6lu %10lu %10lu %8.3f ms\n", s.entry, s.calls,
+                s.requests, s.round_trips, s.bytes_out, s.bytes_in, s.blocked);
+        total.requests += s.requests;
+        total.round_trips += s.round_trips;
+        total.bytes_out += s.bytes_out;
+        total.bytes_in += s.bytes_in;
+        total.blocked += s.blocked;
+    }
+    fprintf(stderr, "%-24s %6s %8lu %6lu %10lu %10lu %8.3f ms\n", "total", "",
+            total.requests, total.round_trips, total.bytes_out, total.bytes_in, total.blocked);
+
+    stats.clear();
+    current_stats = NULL;
+}
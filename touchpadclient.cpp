@@ -0,0 +1,650 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#include <QFile>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QtDBus/QtDBus>
+
+#include <KDebug>
+
+#include "touchpadclient.h"
+
+static const char ServiceName[] = "org.kde.ksyndaemon";
+static const char ServicePath[] = "/Touchpad";
+static const char ServiceInterface[] = "org.kde.Touchpad";
+
+/*
+ * Table entry of a parameter passed by name over D-Bus, NULL if unknown.
+ */
+static const Parameter* findParameter(const QString& name)
+{
+    QByteArray key = name.toLatin1();
+    for (int j = 0; params[j].name; j++)
+        if (!strcasecmp(params[j].name, key.constData()))
+            return &params[j];
+    return NULL;
+}
+
+static QList<int> toList(const device_list& devices)
+{
+    QList<int> ids;
+    for (device_list::const_iterator it = devices.begin(); it != devices.end(); it++)
+        ids.append(*it);
+    return ids;
+}
+
+TouchpadClient::TouchpadClient(QObject* parent)
+    : QObject(parent),
+    service(NULL),
+    notifier(NULL),
+    opened(false),
+    watching(false),
+    analyzing(false),
+    calibrating(false),
+    mapping(false),
+    current(-1)
+{
+    // writes to a service which went away would be lost without a word
+    serviceWatcher = new QDBusServiceWatcher(ServiceName, QDBusConnection::sessionBus(),
+                                             QDBusServiceWatcher::WatchForUnregistration, this);
+    connect(serviceWatcher, SIGNAL(serviceUnregistered(const QString&)),
+            this, SLOT(serviceUnregistered()));
+}
+
+TouchpadClient::~TouchpadClient()
+{
+    close();
+}
+
+int TouchpadClient::open()
+{
+    close();
+    opened = true;
+
+    // an explicit backend asks for direct access, e.g. in the benchmarks
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    if (qgetenv("KCM_TOUCHPAD_BACKEND").isEmpty() && bus.isConnected() &&
+        bus.interface()->isServiceRegistered(ServiceName)) {
+        service = new QDBusInterface(ServiceName, ServicePath, ServiceInterface, bus, this);
+
+        QDBusReply<QVariantList> ids = service->call("devices");
+        if (ids.isValid() && !ids.value().isEmpty()) {
+            foreach (const QVariant& id, ids.value()) {
+                remoteDevices.append(id.toInt());
+                remoteNames[id.toInt()] = QDBusReply<QString>(service->call("deviceName", id.toInt())).value();
+            }
+            current = remoteDevices.first();
+
+            QDBusReply<QStringList> properties = service->call("properties");
+            foreach (const QString& property, properties.value())
+                remoteProperties.insert(property);
+
+            // the cache follows the service whether watched or not
+            bus.connect(ServiceName, ServicePath, ServiceInterface, "parametersChanged",
+                        this, SLOT(remoteParametersChanged(int, const QVariantMap&)));
+            bus.connect(ServiceName, ServicePath, ServiceInterface, "devicesChanged",
+                        this, SLOT(remoteDevicesChanged()));
+            return 0;
+        }
+
+        // an older ksyndaemon, or one which found no touchpad
+        kDebug() << "touchpad service unusable:" << ids.error().message();
+        delete service;
+        service = NULL;
+    }
+
+    return Touchpad::init_xinput_extension();
+}
+
+void TouchpadClient::close()
+{
+    if (!opened)
+        return;
+    stopRawEvents();
+    opened = false;
+    watching = false;
+
+    if (service) {
+        QDBusConnection bus = QDBusConnection::sessionBus();
+        bus.disconnect(ServiceName, ServicePath, ServiceInterface, "parametersChanged",
+                       this, SLOT(remoteParametersChanged(int, const QVariantMap&)));
+        bus.disconnect(ServiceName, ServicePath, ServiceInterface, "devicesChanged",
+                       this, SLOT(remoteDevicesChanged()));
+        delete service;
+        service = NULL;
+        remoteDevices.clear();
+        remoteNames.clear();
+        remoteProperties.clear();
+        remoteValues.clear();
+        current = -1;
+        return;
+    }
+
+    delete notifier;
+    notifier = NULL;
+    Touchpad::free_xinput_extension();
+}
+
+bool TouchpadClient::isRemote() const
+{
+    return service != NULL;
+}
+
+QList<int> TouchpadClient::devices() const
+{
+    if (service)
+        return remoteDevices;
+    return toList(Touchpad::get_devices());
+}
+
+bool TouchpadClient::selectDevice(int id)
+{
+    if (!service)
+        return Touchpad::select_device(id);
+
+    if (!remoteDevices.contains(id))
+        return false;
+    current = id;
+    return true;
+}
+
+int TouchpadClient::currentDevice() const
+{
+    if (service)
+        return current;
+    return Touchpad::get_current_device();
+}
+
+QString TouchpadClient::deviceName() const
+{
+    return deviceName(currentDevice());
+}
+
+QString TouchpadClient::deviceName(int id) const
+{
+    if (service)
+        return remoteNames.value(id);
+    return QString::fromLocal8Bit(Touchpad::get_device_name(id));
+}
+
+QSet<QString> TouchpadClient::properties() const
+{
+    if (service)
+        return remoteProperties;
+
+    QSet<QString> properties;
+    const prop_list* properties_list = Touchpad::get_properties_list();
+    if (properties_list)
+        for (prop_list::const_iterator it = properties_list->begin(); it != properties_list->end(); it++)
+            properties.insert(*it);
+    return properties;
+}
+
+QSet<QString> TouchpadClient::deviceProperties()
+{
+    QSet<QString> properties;
+    if (!service) {
+        for (int j = 0; params[j].name; j++)
+            if (Touchpad::available((ParamId)j))
+                properties.insert(params[j].prop_name);
+        return properties;
+    }
+
+    // the service leaves out what the device lacks
+    if (current == -1)
+        return properties;
+    const param_values& values = snapshot(current);
+    for (param_values::const_iterator it = values.begin(); it != values.end(); ++it) {
+        const Parameter* parameter = findParameter(it->first);
+        if (parameter)
+            properties.insert(parameter->prop_name);
+    }
+    return properties;
+}
+
+bool TouchpadClient::capability(ParamId id)
+{
+    if (!service)
+        return Touchpad::capability(id);
+
+    const param_values& values = snapshot(current);
+    param_values::const_iterator it = values.find(params[id].name);
+    return it == values.end() || it->second != 0;
+}
+
+void TouchpadClient::getParameters(param_values& values)
+{
+    if (!service) {
+        Touchpad::get_parameters(values);
+        return;
+    }
+
+    const param_values& cached = snapshot(current);
+    for (param_values::iterator it = values.begin(); it != values.end(); ) {
+        param_values::const_iterator known = cached.find(it->first);
+        if (known == cached.end()) {
+            values.erase(it++);
+            continue;
+        }
+        it->second = known->second;
+        ++it;
+    }
+}
+
+int TouchpadClient::setParameters(const param_values& values)
+{
+    if (!service) {
+        Touchpad::Transaction transaction;
+        transaction.begin();
+        for (param_values::const_iterator it = values.begin(); it != values.end(); ++it)
+            transaction.set(it->first, it->second);
+        return transaction.commit();
+    }
+
+    QVariantMap map;
+    for (param_values::const_iterator it = values.begin(); it != values.end(); ++it)
+        if (it->second != -1)
+            map.insert(it->first, it->second);
+    if (map.isEmpty() || current == -1)
+        return 0;
+
+    // nothing waits for the reply, the change comes back as a signal;
+    // until then the cache holds what was sent, like the property mirror
+    service->asyncCall("setParameters", current, map);
+    QMap<int, param_values>::iterator cached = remoteValues.find(current);
+    if (cached != remoteValues.end())
+        for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it) {
+            const Parameter* parameter = findParameter(it.key());
+            if (parameter)
+                (*cached)[parameter->name] = it.value().toDouble();
+        }
+    return map.size();
+}
+
+int TouchpadClient::setParameters(const param_values& values, param_values& baseline)
+{
+    if (!service) {
+        Touchpad::Transaction transaction;
+        transaction.begin();
+        for (param_values::const_iterator it = values.begin(); it != values.end(); ++it)
+            transaction.set(it->first, it->second);
+        return transaction.commit(baseline);
+    }
+    if (current == -1)
+        return 0;
+
+    // the service skips what the device lacks, which is tried again next time
+    const param_values& present = snapshot(current);
+    param_values changes;
+    for (param_values::const_iterator it = values.begin(); it != values.end(); ++it) {
+        if (it->second == -1)
+            continue;
+        param_values::const_iterator known = baseline.find(it->first);
+        // compare as floats, the precision float properties are kept in
+        if (known != baseline.end() && (float)known->second == (float)it->second)
+            continue;
+        changes[it->first] = it->second;
+        if (present.find(it->first) != present.end())
+            baseline[it->first] = it->second;
+    }
+
+    return changes.empty() ? 0 : setParameters(changes);
+}
+
+bool TouchpadClient::saveSnapshot(const QString& path)
+{
+    if (!service)
+        return Touchpad::save_snapshot(QFile::encodeName(path).constData());
+
+    QDBusReply<bool> reply = service->call("saveSnapshot", current, path);
+    return reply.isValid() && reply.value();
+}
+
+int TouchpadClient::restoreSnapshot(const QString& path)
+{
+    if (!service) {
+        int restored = Touchpad::restore_snapshot(QFile::encodeName(path).constData());
+        checkQueuedEvents();
+        return restored;
+    }
+
+    // the new values come back as parametersChanged
+    QDBusReply<int> reply = service->call("restoreSnapshot", current, path);
+    return reply.isValid() ? reply.value() : -1;
+}
+
+void TouchpadClient::watch()
+{
+    if (!opened)
+        return;
+    watching = true;
+    // the service's signals are connected already
+    if (service || notifier)
+        return;
+
+    if (Touchpad::connection_number() >= 0) {
+        notifier = new QSocketNotifier(Touchpad::connection_number(), QSocketNotifier::Read, this);
+        connect(notifier, SIGNAL(activated(int)), this, SLOT(eventsPending()));
+        // opening the display read some already
+        checkQueuedEvents();
+    }
+}
+
+// Replies read the events arriving meanwhile into the queue of Xlib, where
+// the notifier does not see them; they would wait for unrelated traffic.
+void TouchpadClient::checkQueuedEvents()
+{
+    if (notifier && Touchpad::events_queued())
+        QTimer::singleShot(0, this, SLOT(eventsPending()));
+}
+
+bool TouchpadClient::startTapAnalysis()
+{
+    stopRawEvents();
+    if (service) {
+        QDBusReply<bool> reply = service->call("startTapAnalysis", current);
+        analyzing = reply.isValid() && reply.value();
+        return analyzing;
+    }
+
+    analyzing = analyses.start_tap_latency();
+    checkQueuedEvents();
+    return analyzing;
+}
+
+void TouchpadClient::stopTapAnalysis()
+{
+    if (!analyzing)
+        return;
+    analyzing = false;
+
+    if (service) {
+        service->asyncCall("stopTapAnalysis");
+        return;
+    }
+    analyses.stop();
+    checkQueuedEvents();
+}
+
+QVariantMap TouchpadClient::tapLatency()
+{
+    if (!analyzing)
+        return QVariantMap();
+    if (service)
+        return QDBusReply<QVariantMap>(service->call("tapLatency")).value();
+
+    QVariantMap results;
+    // ended with its device
+    TapLatency* latency = analyses.tap_latency();
+    if (!latency)
+        return results;
+    results.insert("taps", latency->taps());
+    results.insert("p50", latency->percentile(0.50));
+    results.insert("p95", latency->percentile(0.95));
+    results.insert("p99", latency->percentile(0.99));
+    results.insert("estimated", latency->estimated());
+    return results;
+}
+
+bool TouchpadClient::startCalibration()
+{
+    stopRawEvents();
+    if (service) {
+        QDBusReply<bool> reply = service->call("startCalibration", current);
+        calibrating = reply.isValid() && reply.value();
+        return calibrating;
+    }
+
+    calibrating = analyses.start_calibration();
+    checkQueuedEvents();
+    return calibrating;
+}
+
+void TouchpadClient::stopCalibration()
+{
+    if (!calibrating)
+        return;
+    calibrating = false;
+
+    if (service) {
+        service->asyncCall("stopCalibration");
+        return;
+    }
+    analyses.stop();
+    checkQueuedEvents();
+}
+
+unsigned long TouchpadClient::calibration(param_values& proposal)
+{
+    proposal.clear();
+    if (!calibrating)
+        return 0;
+    if (!service) {
+        EdgeCalibrator* calibrator = analyses.calibrator();
+        if (!calibrator)
+            return 0;
+        calibrator->propose(proposal);
+        return calibrator->samples();
+    }
+
+    QVariantMap results = QDBusReply<QVariantMap>(service->call("calibration")).value();
+    for (QVariantMap::const_iterator it = results.constBegin(); it != results.constEnd(); ++it) {
+        const Parameter* parameter = findParameter(it.key());
+        if (parameter)
+            proposal[parameter->name] = it.value().toDouble();
+    }
+    return results.value("samples").toULongLong();
+}
+
+bool TouchpadClient::startHeatmap()
+{
+    stopRawEvents();
+    if (service) {
+        QDBusReply<bool> reply = service->call("startHeatmap", current);
+        mapping = reply.isValid() && reply.value();
+        return mapping;
+    }
+
+    mapping = analyses.start_heatmap();
+    checkQueuedEvents();
+    return mapping;
+}
+
+void TouchpadClient::stopHeatmap()
+{
+    if (!mapping)
+        return;
+    mapping = false;
+
+    if (service) {
+        service->asyncCall("stopHeatmap");
+        return;
+    }
+    analyses.stop();
+    checkQueuedEvents();
+}
+
+void TouchpadClient::heatmapChanges(QMap<int, unsigned long>& cells)
+{
+    cells.clear();
+    if (!mapping)
+        return;
+
+    if (service) {
+        QVariantList changes = QDBusReply<QVariantList>(service->call("heatmapChanges")).value();
+        for (int k = 0; k + 1 < changes.size(); k += 2)
+            cells.insert(changes[k].toInt(), changes[k + 1].toULongLong());
+        return;
+    }
+
+    TouchHeatmap* heatmap = analyses.heatmap();
+    if (!heatmap)
+        return;
+    unsigned changed[HEATMAP_CELLS];
+    unsigned n = heatmap->take_changes(changed, HEATMAP_CELLS);
+    for (unsigned k = 0; k < n; k++)
+        cells.insert(changed[k], heatmap->count(changed[k]));
+}
+
+// the analyses all take the raw events of the current device
+void TouchpadClient::stopRawEvents()
+{
+    stopTapAnalysis();
+    stopCalibration();
+    stopHeatmap();
+}
+
+/*
+ * All parameter values of a remote device, fetched with a single call
+ * the first time and kept current by remoteParametersChanged().
+ */
+const param_values& TouchpadClient::snapshot(int device)
+{
+    QMap<int, param_values>::iterator it = remoteValues.find(device);
+    if (it != remoteValues.end())
+        return it.value();
+
+    param_values& values = remoteValues[device];
+    QDBusReply<QVariantMap> reply = service->call("parameters", device);
+    QVariantMap map = reply.value();
+    for (QVariantMap::const_iterator v = map.constBegin(); v != map.constEnd(); ++v) {
+        const Parameter* parameter = findParameter(v.key());
+        if (parameter)
+            values[parameter->name] = v.value().toDouble();
+    }
+    return values;
+}
+
+void TouchpadClient::eventsPending()
+{
+    prop_list changed;
+    device_list added, removed;
+
+    Touchpad::process_events(changed, &added, &removed);
+
+    analyses.events_processed();
+
+    if (!added.empty() || !removed.empty())
+        emit devicesChanged(toList(added), toList(removed));
+
+    if (changed.empty())
+        return;
+
+    analyses.parameters_changed(Touchpad::get_current_device());
+
+    QSet<QString> properties;
+    for (prop_list::const_iterator it = changed.begin(); it != changed.end(); it++)
+        properties.insert(*it);
+    emit parametersChanged(properties);
+}
+
+void TouchpadClient::remoteParametersChanged(int device, const QVariantMap& values)
+{
+    QMap<int, param_values>::iterator cached = remoteValues.find(device);
+    QSet<QString> properties;
+
+    for (QVariantMap::const_iterator it = values.constBegin(); it != values.constEnd(); ++it) {
+        const Parameter* parameter = findParameter(it.key());
+        if (!parameter)
+            continue;
+        // without a snapshot the values are fetched when needed
+        if (cached != remoteValues.end())
+            (*cached)[parameter->name] = it.value().toDouble();
+        properties.insert(parameter->prop_name);
+    }
+
+    if (device == current && !properties.isEmpty())
+        emit parametersChanged(properties);
+}
+
+void TouchpadClient::remoteDevicesChanged()
+{
+    QDBusReply<QVariantList> reply = service->call("devices");
+    QList<int> ids, added, removed;
+
+    foreach (const QVariant& id, reply.value())
+        ids.append(id.toInt());
+
+    foreach (int id, remoteDevices) {
+        if (ids.contains(id))
+            continue;
+        removed.append(id);
+        remoteNames.remove(id);
+        remoteValues.remove(id);
+    }
+    foreach (int id, ids) {
+        if (remoteDevices.contains(id))
+            continue;
+        added.append(id);
+        remoteNames[id] = QDBusReply<QString>(service->call("deviceName", id)).value();
+    }
+    remoteDevices = ids;
+
+    // like the Touchpad namespace, fall back to another device
+    if (!remoteDevices.contains(current))
+        current = remoteDevices.isEmpty() ? -1 : remoteDevices.first();
+
+    if (!added.isEmpty() || !removed.isEmpty())
+        emit devicesChanged(added, removed);
+}
+
+/*
+ * ksyndaemon quit or restarts: reopens, which falls back to the display
+ * unless the service is back already, and has everything shown refetched,
+ * as writes sent meanwhile went nowhere.
+ */
+void TouchpadClient::serviceUnregistered()
+{
+    if (!service)
+        return;
+
+    kDebug() << "touchpad service went away, reopening";
+    QList<int> before = remoteDevices;
+    QSet<QString> properties = remoteProperties;
+    int shown = current;
+    bool watched = watching;
+
+    open();
+    selectDevice(shown);
+    if (watched)
+        watch();
+
+    QList<int> after = devices(), added, removed;
+    foreach (int id, before)
+        if (!after.contains(id))
+            removed.append(id);
+    foreach (int id, after)
+        if (!before.contains(id))
+            added.append(id);
+    if (!added.isEmpty() || !removed.isEmpty())
+        emit devicesChanged(added, removed);
+
+    properties |= this->properties();
+    if (!properties.isEmpty())
+        emit parametersChanged(properties);
+}
+
+#include "touchpadclient.moc"
@@ -0,0 +1,151 @@
+/*
+ * Copyright © 2009 Michał Żarłok
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the names of the authors
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Authors
+ * makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Michał Żarłok
+ */
+
+#ifndef _TOUCHPADCLIENT_H
+#define _TOUCHPADCLIENT_H
+
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QVariantMap>
+
+#include "touchpad.h"
+#include "touchpad_analyses.h"
+
+class QDBusInterface;
+class QDBusServiceWatcher;
+class QSocketNotifier;
+
+/*
+ * Touchpad access of the control module and kcminit. While ksyndaemon
+ * runs, everything goes through its touchpad service: parameter values are
+ * taken from one snapshot per device and kept current by the service's
+ * change signals, so reads cost nothing and writes are single one-way
+ * calls. Otherwise, or when a backend is chosen with KCM_TOUCHPAD_BACKEND,
+ * the display is opened here, as it is when the service goes away while
+ * the client is open.
+ *
+ * Like the Touchpad namespace, parameter access works on a selected device.
+ */
+class TouchpadClient : public QObject
+{
+  Q_OBJECT
+
+public:
+    TouchpadClient(QObject* parent = 0);
+    ~TouchpadClient();
+
+    /* negative when there is neither the service nor a touchpad */
+    int open();
+    void close();
+    bool isRemote() const;
+
+    QList<int> devices() const;
+    bool selectDevice(int id);
+    int currentDevice() const;
+    /* empty when there is no device */
+    QString deviceName() const;
+    QString deviceName(int id) const;
+
+    /* synaptics properties known to the server */
+    QSet<QString> properties() const;
+    /* synaptics properties the current device has */
+    QSet<QString> deviceProperties();
+    /* true unless the current device reports it lacks the capability */
+    bool capability(ParamId id);
+
+    /* fills the given parameters, those which cannot be read are removed */
+    void getParameters(param_values& values);
+    /* one batch, -1 values are ignored like with Touchpad::Transaction */
+    int setParameters(const param_values& values);
+    /* only what differs from baseline, which is updated with what was sent */
+    int setParameters(const param_values& values, param_values& baseline);
+
+    /* of the current device, see Touchpad::save_snapshot() */
+    bool saveSnapshot(const QString& path);
+    int restoreSnapshot(const QString& path);
+
+    /* starts following changes made by others, see the signals */
+    void watch();
+
+    /* measures the tap to click delays of the current device while
+     * watching, see TouchpadService::tapLatency() for the results */
+    bool startTapAnalysis();
+    void stopTapAnalysis();
+    QVariantMap tapLatency();
+
+    /* collects the positions of the current device while watching, see
+     * TouchpadService::startCalibration(); calibration() fills proposal
+     * once enough were collected and returns how many there are */
+    bool startCalibration();
+    void stopCalibration();
+    unsigned long calibration(param_values& proposal);
+
+    /* counts where the finger touches the current device while
+     * watching, see TouchpadService::startHeatmap(); heatmapChanges()
+     * fills cells with the cells changed since the last call and their
+     * counts */
+    bool startHeatmap();
+    void stopHeatmap();
+    void heatmapChanges(QMap<int, unsigned long>& cells);
+
+signals:
+    /* properties of the current device changed */
+    void parametersChanged(const QSet<QString>& properties);
+    void devicesChanged(const QList<int>& added, const QList<int>& removed);
+
+private slots:
+    void eventsPending();
+    void remoteParametersChanged(int device, const QVariantMap& values);
+    void remoteDevicesChanged();
+    void serviceUnregistered();
+
+private:
+    const param_values& snapshot(int device);
+    void stopRawEvents();
+    void checkQueuedEvents();
+
+    QDBusInterface* service;
+    QDBusServiceWatcher* serviceWatcher;
+    QSocketNotifier* notifier;
+    bool opened;
+    bool watching;
+    /* local ones, the flags are set for remote ones too */
+    RawEventAnalyses analyses;
+    bool analyzing;
+    bool calibrating;
+    bool mapping;
+
+    /* remote state */
+    QList<int> remoteDevices;
+    QMap<int, QString> remoteNames;
+    QSet<QString> remoteProperties;
+    QMap<int, param_values> remoteValues;
+    int current;
+};
+
+#endif